@@ -0,0 +1,405 @@
+#ifndef ACTION_LOG_HPP
+#define ACTION_LOG_HPP
+#include "PDOGS.cpp"
+
+#include <cstring>
+#include <limits>
+#include <ostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary log of the actions of one game, exact enough to replay it.
+//
+// Layout (little endian):
+//   header   "PDAL", u16 version, u16 reserved, i32 common divisor, u32 seed
+//   records  varint tick delta, u8 action type, u8 row, u8 col
+//
+// Only actions other than None are stored. Each record carries the number of
+// ticks since the previous record (or since tick 0), so a stretch of None
+// actions costs nothing beyond the one or two bytes of the next delta. The
+// game manager asks for an action every 3 ticks, so record ticks are
+// increasing multiples of 3.
+
+struct ActionLogHeader
+{
+    static constexpr char kMagic[4] = {'P', 'D', 'A', 'L'};
+    static constexpr std::uint16_t kVersion = 1;
+    static constexpr std::size_t kSize = 16;
+
+    int commonDivisor;
+    unsigned int seed;
+};
+
+struct ActionLogRecord
+{
+    int tick;
+    Feis::PlayerAction action;
+};
+
+// Appends records to a stream as they happen, so nothing but the stream's own
+// buffer is held in memory.
+class ActionLogWriter
+{
+public:
+    ActionLogWriter(std::ostream &out, const ActionLogHeader &header) : out_(out), lastTick_{}
+    {
+        unsigned char bytes[ActionLogHeader::kSize] = {};
+        std::memcpy(bytes, ActionLogHeader::kMagic, 4);
+        StoreLittleEndian(bytes + 4, ActionLogHeader::kVersion, 2);
+        StoreLittleEndian(bytes + 8, static_cast<std::uint32_t>(header.commonDivisor), 4);
+        StoreLittleEndian(bytes + 12, header.seed, 4);
+        out_.write(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+    }
+
+    // Records action as taken at tick, a multiple of 3 after that of the
+    // previous call. None actions and actions outside the board have no
+    // effect and are dropped.
+    void Append(int tick, const Feis::PlayerAction &action)
+    {
+        assert(tick > lastTick_ && tick % 3 == 0);
+
+        if (action.type == Feis::PlayerActionType::None || !Feis::IsWithinBoard(action.cellPosition))
+            return;
+
+        unsigned char bytes[8];
+        std::size_t size = 0;
+        for (std::uint32_t delta = tick - lastTick_;; delta >>= 7)
+        {
+            bytes[size++] = static_cast<unsigned char>(delta & 0x7F) | (delta >= 0x80 ? 0x80 : 0);
+            if (delta < 0x80)
+                break;
+        }
+        bytes[size++] = static_cast<unsigned char>(action.type);
+        bytes[size++] = static_cast<unsigned char>(action.cellPosition.row);
+        bytes[size++] = static_cast<unsigned char>(action.cellPosition.col);
+        out_.write(reinterpret_cast<const char *>(bytes), size);
+        lastTick_ = tick;
+    }
+
+    void Flush()
+    {
+        out_.flush();
+    }
+
+private:
+    static void StoreLittleEndian(unsigned char *bytes, std::uint32_t value, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+    }
+
+    std::ostream &out_;
+    int lastTick_;
+};
+
+// Decodes a log held in memory. The bytes are not copied; they must outlive
+// the reader.
+class ActionLogReader
+{
+public:
+    // Where the next record starts, and the tick its delta is relative to.
+    struct Position
+    {
+        std::size_t offset;
+        int tick;
+    };
+
+    ActionLogReader() : data_{}, size_{}, header_{}, offset_{}, tick_{}, malformed_{}
+    {
+    }
+
+    ActionLogReader(const unsigned char *data, std::size_t size)
+        : data_(data), size_(size), header_{}, offset_{ActionLogHeader::kSize}, tick_{}, malformed_{}
+    {
+        if (size_ < ActionLogHeader::kSize || std::memcmp(data_, ActionLogHeader::kMagic, 4) != 0 ||
+            LoadLittleEndian(data_ + 4, 2) != ActionLogHeader::kVersion)
+        {
+            data_ = nullptr;
+            size_ = 0;
+            offset_ = 0;
+            return;
+        }
+        header_.commonDivisor = static_cast<int>(LoadLittleEndian(data_ + 8, 4));
+        header_.seed = LoadLittleEndian(data_ + 12, 4);
+    }
+
+    // False if the bytes are not an action log of a known version.
+    bool IsValid() const
+    {
+        return data_ != nullptr;
+    }
+
+    const ActionLogHeader &GetHeader() const
+    {
+        return header_;
+    }
+
+    // The bytes of the whole log, header included.
+    const unsigned char *GetData() const
+    {
+        return data_;
+    }
+
+    std::size_t GetSize() const
+    {
+        return size_;
+    }
+
+    Position GetPosition() const
+    {
+        return {offset_, tick_};
+    }
+
+    // Moves back (or ahead) to a GetPosition() of this log.
+    void SetPosition(Position position)
+    {
+        offset_ = position.offset;
+        tick_ = position.tick;
+        malformed_ = false;
+    }
+
+    // Decodes the next record into record; false at the end of the log, at
+    // a record truncated by the end of the log (as when a recording was cut
+    // short), or at a record that cannot be in a log, after which
+    // IsMalformed() is true and the reader stays at the start of that record.
+    bool Next(ActionLogRecord &record)
+    {
+        if (malformed_ || offset_ >= size_)
+            return false;
+
+        const std::size_t start = offset_;
+        std::uint32_t delta = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            if (offset_ >= size_)
+                return false;
+            const unsigned char byte = data_[offset_++];
+            // The fifth byte holds the top 4 bits of the delta and ends it.
+            if (shift == 28 && (byte & 0xF0))
+                return Reject(start);
+            delta |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        if (offset_ + 3 > size_)
+        {
+            offset_ = size_;
+            return false;
+        }
+        if (delta == 0 || delta % 3 != 0 ||
+            delta > static_cast<std::uint32_t>(std::numeric_limits<int>::max() - tick_))
+            return Reject(start);
+
+        const ActionLogRecord decoded{
+            tick_ + static_cast<int>(delta),
+            {static_cast<Feis::PlayerActionType>(data_[offset_]), {data_[offset_ + 1], data_[offset_ + 2]}}};
+        if (decoded.action.type == Feis::PlayerActionType::None ||
+            decoded.action.type > Feis::PlayerActionType::Clear || !Feis::IsWithinBoard(decoded.action.cellPosition))
+            return Reject(start);
+
+        tick_ = decoded.tick;
+        record = decoded;
+        offset_ += 3;
+        return true;
+    }
+
+    // True once Next() has met a record whose tick is not a multiple of 3
+    // after that of the previous one, or whose action the writer never
+    // stores.
+    bool IsMalformed() const
+    {
+        return malformed_;
+    }
+
+private:
+    bool Reject(std::size_t offset)
+    {
+        offset_ = offset;
+        malformed_ = true;
+        return false;
+    }
+
+    static std::uint32_t LoadLittleEndian(const unsigned char *bytes, std::size_t size)
+    {
+        std::uint32_t value = 0;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            value |= static_cast<std::uint32_t>(bytes[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    const unsigned char *data_;
+    std::size_t size_;
+    ActionLogHeader header_;
+    std::size_t offset_;
+    int tick_;
+    bool malformed_;
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filename) : data_{}, size_{}
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr)
+            {
+                data_ = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                size_ = data_ != nullptr ? static_cast<std::size_t>(size.QuadPart) : 0;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        const int file = open(filename.c_str(), O_RDONLY);
+        if (file < 0)
+            return;
+        struct stat status;
+        if (fstat(file, &status) == 0 && status.st_size > 0)
+        {
+            void *data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED)
+            {
+                data_ = static_cast<const unsigned char *>(data);
+                size_ = static_cast<std::size_t>(status.st_size);
+            }
+        }
+        close(file);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (data_ == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(const_cast<unsigned char *>(data_), size_);
+#endif
+    }
+
+    // Null if the file could not be opened or is empty.
+    const unsigned char *GetData() const
+    {
+        return data_;
+    }
+
+    std::size_t GetSize() const
+    {
+        return size_;
+    }
+
+private:
+    const unsigned char *data_;
+    std::size_t size_;
+};
+
+// Forwards the actions of another player and appends each one to a log,
+// stamped with the tick at which the game manager applies it.
+class ActionLogRecorder : public Feis::IGamePlayer
+{
+public:
+    ActionLogRecorder(Feis::IGamePlayer *player, ActionLogWriter *writer) : player_(player), writer_(writer)
+    {
+    }
+
+    Feis::PlayerAction GetNextAction(const Feis::IGameInfo &info) override
+    {
+        const Feis::PlayerAction action = player_->GetNextAction(info);
+        writer_->Append(info.GetElapsedTime(), action);
+        return action;
+    }
+
+    bool IsFinished() const override
+    {
+        return player_->IsFinished();
+    }
+
+private:
+    Feis::IGamePlayer *player_;
+    ActionLogWriter *writer_;
+};
+
+// Plays back a log: each recorded action is returned at exactly its tick and
+// None everywhere else. Finished once every record has been played.
+class ActionLogPlayer : public Feis::IGamePlayer
+{
+public:
+    // Plays the records of reader from its current position on.
+    explicit ActionLogPlayer(const ActionLogReader &reader) : reader_(reader), position_{}, next_{}, hasNext_{}
+    {
+        Advance();
+    }
+
+    Feis::PlayerAction GetNextAction(const Feis::IGameInfo &info) override
+    {
+        if (!hasNext_ || next_.tick != info.GetElapsedTime())
+        {
+            assert(!hasNext_ || next_.tick > info.GetElapsedTime());
+            return {Feis::PlayerActionType::None, {0, 0}};
+        }
+
+        const Feis::PlayerAction action = next_.action;
+        Advance();
+        return action;
+    }
+
+    // Position of the first record not played yet. A player started there
+    // continues this one.
+    ActionLogReader::Position GetPosition() const
+    {
+        return position_;
+    }
+
+    bool IsFinished() const override
+    {
+        return !hasNext_;
+    }
+
+    // True if playback stopped at a malformed record rather than at the end
+    // of the log.
+    bool IsMalformed() const
+    {
+        return reader_.IsMalformed();
+    }
+
+private:
+    void Advance()
+    {
+        position_ = reader_.GetPosition();
+        hasNext_ = reader_.Next(next_);
+    }
+
+    ActionLogReader reader_;
+    ActionLogReader::Position position_;
+    ActionLogRecord next_;
+    bool hasNext_;
+};
+
+#endif
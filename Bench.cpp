@@ -0,0 +1,364 @@
+#define USE_ENGINE_ONLY
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+
+#include "PDOGS.cpp"
+
+#include "BenchLayouts.hpp"
+#include "GreedyPlayer.hpp"
+#include "ThroughputModel.hpp"
+
+// Usage: pdogs_bench [--filter SUBSTRING] [--repetitions N] [--min-time SECONDS] [--list]
+//
+// Every benchmark builds a fresh fixture per repetition and times a batch of
+// iterations of one operation. The batch size is calibrated once so that a
+// batch takes at least --min-time, then kept for every repetition; the
+// reported time per iteration is the median and minimum over repetitions.
+
+struct Benchmark
+{
+    std::string name;
+    // Builds a fixture and returns its operation. One call of the operation
+    // is one iteration; it returns the number of items it processed (e.g.
+    // products delivered), or 0 when the benchmark has no item count.
+    std::function<std::function<std::size_t()>()> setup;
+};
+
+struct BenchmarkResult
+{
+    std::size_t iterations;
+    double medianNanoseconds;
+    double minNanoseconds;
+    double maxNanoseconds;
+    double itemsPerSecond;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double TimeBatch(const std::function<std::size_t()> &operation, std::size_t iterations, std::size_t &items)
+{
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        items += operation();
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+BenchmarkResult Run(const Benchmark &benchmark, int repetitions, double minTime)
+{
+    std::size_t iterations = 1;
+    {
+        const std::function<std::size_t()> operation = benchmark.setup();
+        std::size_t items = 0;
+        while (true)
+        {
+            const double elapsed = TimeBatch(operation, iterations, items);
+            if (elapsed >= minTime)
+                break;
+            const double scale = elapsed > 0 ? minTime / elapsed * 1.2 : 10.0;
+            iterations = static_cast<std::size_t>(iterations * std::min(10.0, std::max(2.0, scale)));
+        }
+    }
+
+    std::vector<double> nanoseconds;
+    std::size_t totalItems = 0;
+    double totalSeconds = 0;
+    for (int repetition = 0; repetition < repetitions; ++repetition)
+    {
+        const std::function<std::size_t()> operation = benchmark.setup();
+        const double elapsed = TimeBatch(operation, iterations, totalItems);
+        totalSeconds += elapsed;
+        nanoseconds.push_back(elapsed * 1e9 / iterations);
+    }
+
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+    return {iterations, nanoseconds[nanoseconds.size() / 2], nanoseconds.front(), nanoseconds.back(),
+            totalSeconds > 0 ? totalItems / totalSeconds : 0};
+}
+
+template <typename TGameBoard>
+void SetSchedulingMode(TGameBoard &, Feis::SchedulingMode)
+{
+}
+
+void SetSchedulingMode(Feis::GameBoard &board, Feis::SchedulingMode mode)
+{
+    board.SetSchedulingMode(mode);
+}
+
+// A board on its own, with the stand-in manager its collection center reports
+// to. Held by pointer because VariantGameBoard cannot be moved.
+template <typename TGameBoard>
+struct BoardFixture
+{
+    BenchGameManager sink;
+    TGameBoard board;
+};
+
+// Times TGameBoard::Update() on a layout after warmupTicks ticks; the items
+// are the products delivered to the collection center.
+template <typename TGameBoard>
+Benchmark UpdateBenchmark(const std::string &name, Feis::SchedulingMode mode, int warmupTicks,
+                          void (*layout)(TGameBoard &, BenchGameManager *))
+{
+    return {name, [=]() {
+                auto fixture = std::make_shared<BoardFixture<TGameBoard>>();
+                SetSchedulingMode(fixture->board, mode);
+                layout(fixture->board, &fixture->sink);
+                for (int tick = 0; tick < warmupTicks; ++tick)
+                {
+                    fixture->board.Update();
+                }
+                return std::function<std::size_t()>([fixture]() {
+                    const std::size_t delivered = fixture->sink.GetDelivered();
+                    fixture->board.Update();
+                    return fixture->sink.GetDelivered() - delivered;
+                });
+            }};
+}
+
+// Builds a conveyor or a combiner on a random tile, or removes the cell that
+// is already there.
+template <typename TGameBoard>
+Benchmark ChurnBenchmark(const std::string &name, Feis::SchedulingMode mode)
+{
+    return {name, [=]() {
+                auto fixture = std::make_shared<BoardFixture<TGameBoard>>();
+                SetSchedulingMode(fixture->board, mode);
+                BenchLayouts::BuildEmpty(fixture->board, &fixture->sink);
+                auto tiles = std::make_shared<std::vector<Feis::CellPosition>>(BenchLayouts::FreeTiles());
+                auto gen = std::make_shared<std::mt19937>(0);
+                return std::function<std::size_t()>([fixture, tiles, gen]() {
+                    const unsigned int random = (*gen)();
+                    const Feis::CellPosition position = (*tiles)[random % tiles->size()];
+                    const Feis::Direction direction = static_cast<Feis::Direction>(random >> 16 & 3);
+                    const bool built = random >> 20 & 3
+                                           ? fixture->board.template Build<Feis::ConveyorCell>(position, direction)
+                                           : fixture->board.template Build<Feis::CombinerCell>(position, direction);
+                    if (!built)
+                    {
+                        fixture->board.Remove(position);
+                    }
+                    return std::size_t{0};
+                });
+            }};
+}
+
+// The engine side of a GUI frame: one tick of a game played by GreedyPlayer,
+// then the three full-board passes of GameRenderer::Render() over IGameInfo,
+// with a visitor that does nothing in place of the draw calls. The items are
+// the cells visited.
+template <typename TGameBoard>
+Benchmark FrameBenchmark(const std::string &name)
+{
+    struct Fixture
+    {
+        GreedyPlayer player;
+        Feis::BasicGameManager<TGameBoard> manager{&player, 1, 0};
+    };
+
+    struct CountingVisitor : Feis::CellVisitor
+    {
+        std::size_t *visits;
+        void Visit(const Feis::NumberCell *) const override { ++*visits; }
+        void Visit(const Feis::CollectionCenterCell *) const override { ++*visits; }
+        void Visit(const Feis::MiningMachineCell *) const override { ++*visits; }
+        void Visit(const Feis::ConveyorCell *) const override { ++*visits; }
+        void Visit(const Feis::CombinerCell *) const override { ++*visits; }
+        void Visit(const Feis::WallCell *) const override { ++*visits; }
+    };
+
+    return {name, []() {
+                auto fixture = std::make_shared<Fixture>();
+                return std::function<std::size_t()>([fixture]() {
+                    if (fixture->manager.IsGameOver())
+                    {
+                        fixture->player = GreedyPlayer();
+                        fixture->manager.Reset(&fixture->player, 1, 0);
+                    }
+                    fixture->manager.Update();
+
+                    const Feis::IGameInfo &info = fixture->manager;
+                    std::size_t visits = 0;
+                    CountingVisitor visitor;
+                    visitor.visits = &visits;
+                    for (int pass = 0; pass < 3; ++pass)
+                    {
+                        for (int row = 0; row < Feis::GameManagerConfig::kBoardHeight; ++row)
+                        {
+                            for (int col = 0; col < Feis::GameManagerConfig::kBoardWidth; ++col)
+                            {
+                                const Feis::LayeredCell &cell = info.GetLayeredCell({row, col});
+                                if (cell.GetBackground() != nullptr)
+                                    cell.GetBackground()->Accept(&visitor);
+                                if (cell.GetForeground() != nullptr)
+                                    cell.GetForeground()->Accept(&visitor);
+                            }
+                        }
+                    }
+                    return visits;
+                });
+            }};
+}
+
+// The final score of the layout GreedyPlayer builds for Test3A, predicted by
+// ThroughputModel or by simulating the rest of the game on a fork.
+Benchmark PredictBenchmark(const std::string &name, bool simulate)
+{
+    struct Fixture
+    {
+        GreedyPlayer player;
+        Feis::GameManager manager{&player, 3, 30};
+        ThroughputModel model;
+    };
+
+    return {name, [simulate]() {
+                auto fixture = std::make_shared<Fixture>();
+                while (!fixture->player.IsFinished())
+                {
+                    fixture->manager.Update();
+                }
+                return std::function<std::size_t()>([fixture, simulate]() {
+                    if (!simulate)
+                    {
+                        fixture->model.Compute(fixture->manager);
+                        return std::size_t{0};
+                    }
+                    auto fork = fixture->manager.Fork();
+                    while (!fork->IsGameOver())
+                    {
+                        fork->Update();
+                    }
+                    return std::size_t{0};
+                });
+            }};
+}
+
+template <typename TGameBoard>
+void AddBoardBenchmarks(std::vector<Benchmark> &benchmarks, const std::string &engine,
+                        Feis::SchedulingMode mode = Feis::SchedulingMode::kEveryTick)
+{
+    using namespace BenchLayouts;
+
+    benchmarks.push_back(UpdateBenchmark<TGameBoard>("update/empty/" + engine, mode, 0, &BuildEmpty<TGameBoard>));
+    benchmarks.push_back(UpdateBenchmark<TGameBoard>("update/sparse/" + engine, mode, 1000, &BuildSparse<TGameBoard>));
+    benchmarks.push_back(UpdateBenchmark<TGameBoard>("update/dense/" + engine, mode, 1000, &BuildDense<TGameBoard>));
+    benchmarks.push_back(
+        UpdateBenchmark<TGameBoard>("update/saturated/" + engine, mode, 3000, &BuildSaturated<TGameBoard>));
+    benchmarks.push_back(UpdateBenchmark<TGameBoard>(
+        "conveyor_chain/" + engine, mode, 5000, [](TGameBoard &board, BenchGameManager *sink) {
+            BuildSerpentine(board, sink);
+        }));
+    benchmarks.push_back(ChurnBenchmark<TGameBoard>("build_remove/" + engine, mode));
+}
+
+std::vector<Benchmark> CreateBenchmarks()
+{
+    std::vector<Benchmark> benchmarks;
+
+    AddBoardBenchmarks<Feis::GameBoard>(benchmarks, "object");
+    AddBoardBenchmarks<Feis::GameBoard>(benchmarks, "event", Feis::SchedulingMode::kEventDriven);
+    AddBoardBenchmarks<Feis::GameBoard>(benchmarks, "parallel", Feis::SchedulingMode::kParallel);
+    AddBoardBenchmarks<Feis::GameBoard>(benchmarks, "pipelined", Feis::SchedulingMode::kPipelined);
+    AddBoardBenchmarks<Feis::FlatGameBoard>(benchmarks, "flat");
+    AddBoardBenchmarks<Feis::VariantGameBoard>(benchmarks, "variant");
+    AddBoardBenchmarks<Feis::ChunkedGameBoard>(benchmarks, "chunked");
+
+    for (const Feis::CellAllocation allocation : {Feis::CellAllocation::kHeap, Feis::CellAllocation::kArena})
+    {
+        const std::string suffix = allocation == Feis::CellAllocation::kHeap ? "heap" : "arena";
+        benchmarks.push_back({"game_manager/construct/" + suffix, [allocation]() {
+                                  auto seed = std::make_shared<unsigned int>(0);
+                                  return std::function<std::size_t()>([allocation, seed]() {
+                                      Feis::GameManager manager(nullptr, 1, (*seed)++, allocation);
+                                      return static_cast<std::size_t>(manager.GetScores());
+                                  });
+                              }});
+    }
+    benchmarks.push_back({"game_manager/reset/arena", []() {
+                              auto manager = std::make_shared<Feis::GameManager>(nullptr, 1, 0, Feis::CellAllocation::kArena);
+                              auto seed = std::make_shared<unsigned int>(0);
+                              return std::function<std::size_t()>([manager, seed]() {
+                                  manager->Reset(nullptr, 1, ++*seed);
+                                  return std::size_t{0};
+                              });
+                          }});
+
+    benchmarks.push_back(FrameBenchmark<Feis::GameBoard>("frame/object"));
+    benchmarks.push_back(FrameBenchmark<Feis::FlatGameBoard>("frame/flat"));
+    benchmarks.push_back(FrameBenchmark<Feis::VariantGameBoard>("frame/variant"));
+
+    benchmarks.push_back(PredictBenchmark("predict/model", false));
+    benchmarks.push_back(PredictBenchmark("predict/simulate", true));
+    return benchmarks;
+}
+
+int main(int argc, char **argv)
+{
+    std::string filter;
+    int repetitions = 5;
+    double minTime = 0.1;
+    bool list = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (arg == "--repetitions" && i + 1 < argc)
+        {
+            repetitions = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--min-time" && i + 1 < argc)
+        {
+            minTime = std::stod(argv[++i]);
+        }
+        else if (arg == "--list")
+        {
+            list = true;
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--filter SUBSTRING] [--repetitions N] [--min-time SECONDS] [--list]" << std::endl;
+            return 1;
+        }
+    }
+
+#ifndef NDEBUG
+    std::cerr << "warning: assertions are enabled; build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers"
+              << std::endl;
+#endif
+
+    if (!list)
+    {
+        std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(12) << "iterations"
+                  << std::setw(14) << "median ns" << std::setw(14) << "min ns" << std::setw(9) << "spread"
+                  << std::setw(14) << "items/s" << std::endl;
+    }
+
+    for (const Benchmark &benchmark : CreateBenchmarks())
+    {
+        if (benchmark.name.find(filter) == std::string::npos)
+            continue;
+        if (list)
+        {
+            std::cout << benchmark.name << std::endl;
+            continue;
+        }
+
+        const BenchmarkResult result = Run(benchmark, repetitions, minTime);
+        std::cout << std::left << std::setw(32) << benchmark.name << std::right << std::setw(12) << result.iterations
+                  << std::fixed << std::setprecision(1) << std::setw(14) << result.medianNanoseconds << std::setw(14)
+                  << result.minNanoseconds << std::setw(8)
+                  << (result.maxNanoseconds - result.minNanoseconds) / result.medianNanoseconds * 100 << "%";
+        if (result.itemsPerSecond > 0)
+            std::cout << std::setw(14) << std::setprecision(0) << result.itemsPerSecond;
+        std::cout << std::endl;
+    }
+}
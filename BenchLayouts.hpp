@@ -0,0 +1,189 @@
+#ifndef BENCH_LAYOUTS_HPP
+#define BENCH_LAYOUTS_HPP
+#include "PDOGS.cpp"
+
+#include <vector>
+
+// Synthetic layouts for pdogs_bench. They are built straight onto a bare board
+// (no seed, no walls, no player), so every engine sees the same cells and the
+// numbers only depend on the layout. The layouts are templated on the board so
+// that GameBoard, FlatGameBoard and VariantGameBoard can be compared.
+
+// Stands in for the GameManager of a bare board: it only counts the products
+// delivered to the collection center.
+class BenchGameManager : public Feis::IGameManager
+{
+public:
+    std::string GetLevelInfo() const override { return "(1)"; }
+    const Feis::LayeredCell &GetLayeredCell(Feis::CellPosition) const override { return empty_; }
+    bool IsScoredProduct(int) const override { return true; }
+    int GetScores() const override { return static_cast<int>(delivered_); }
+    int GetEndTime() const override { return Feis::GameManagerConfig::kEndTime; }
+    int GetElapsedTime() const override { return 0; }
+    bool IsGameOver() const override { return false; }
+    std::uint64_t GetStateHash() const override { return 0; }
+    int GetDistanceToCollectionCenter(Feis::CellPosition) const override { return Feis::DistanceField::kUnreachable; }
+    const Feis::NumberCellIndex &GetNumberCellIndex() const override { return numberCells_; }
+
+    void OnProductReceived(int) override { ++delivered_; }
+
+    std::size_t GetDelivered() const { return delivered_; }
+
+private:
+    Feis::LayeredCell empty_;
+    Feis::NumberCellIndex numberCells_;
+    std::size_t delivered_ = 0;
+};
+
+namespace BenchLayouts
+{
+    using CellPosition = Feis::CellPosition;
+    using Direction = Feis::Direction;
+
+    constexpr int kWidth = Feis::GameManagerConfig::kBoardWidth;
+    constexpr int kHeight = Feis::GameManagerConfig::kBoardHeight;
+    constexpr int kTop = Feis::GameManager::CollectionCenterConfig::kTop;
+    constexpr int kLeft = Feis::GameManager::CollectionCenterConfig::kLeft;
+    constexpr int kBottom = kTop + static_cast<int>(Feis::GameManagerConfig::kGoalSize);
+    constexpr int kRight = kLeft + static_cast<int>(Feis::GameManagerConfig::kGoalSize);
+
+    // Points from a lane tile toward the collection center.
+    inline Direction Inward(CellPosition position)
+    {
+        if (position.col < kLeft)
+            return Direction::kRight;
+        if (position.col >= kRight)
+            return Direction::kLeft;
+        return position.row < kTop ? Direction::kBottom : Direction::kTop;
+    }
+
+    template <typename TGameBoard>
+    void BuildMiningMachine(TGameBoard &board, CellPosition position, Direction direction)
+    {
+        board.SetBackground(position, std::make_shared<Feis::NumberCell>(1));
+        board.template Build<Feis::MiningMachineCell>(position, direction);
+    }
+
+    // The collection center alone.
+    template <typename TGameBoard>
+    void BuildEmpty(TGameBoard &board, BenchGameManager *sink)
+    {
+        board.template Build<Feis::CollectionCenterCell>(CellPosition{kTop, kLeft}, sink);
+    }
+
+    // One lane per collection center row on each side, fed by a mining
+    // machine at its outer end, like the lanes of GreedyPlayer.
+    template <typename TGameBoard>
+    void BuildSparse(TGameBoard &board, BenchGameManager *sink)
+    {
+        BuildEmpty(board, sink);
+        for (int row = kTop; row < kBottom; ++row)
+        {
+            for (int col = 1; col < kLeft; ++col)
+                board.template Build<Feis::ConveyorCell>(CellPosition{row, col}, Direction::kRight);
+            for (int col = kRight; col < kWidth - 1; ++col)
+                board.template Build<Feis::ConveyorCell>(CellPosition{row, col}, Direction::kLeft);
+            BuildMiningMachine(board, {row, 0}, Direction::kRight);
+            BuildMiningMachine(board, {row, kWidth - 1}, Direction::kLeft);
+        }
+    }
+
+    // Every free tile holds a conveyor: a lane per row on each side, draining
+    // into vertical trunks above and below the collection center. Only the
+    // lane ends mine, so most conveyors are idle.
+    template <typename TGameBoard>
+    void BuildDense(TGameBoard &board, BenchGameManager *sink)
+    {
+        BuildEmpty(board, sink);
+        for (int row = 0; row < kHeight; ++row)
+        {
+            for (int col = 1; col < kWidth - 1; ++col)
+            {
+                const CellPosition position{row, col};
+                if (row >= kTop && row < kBottom && col >= kLeft && col < kRight)
+                    continue;
+                board.template Build<Feis::ConveyorCell>(position, Inward(position));
+            }
+            BuildMiningMachine(board, {row, 0}, Direction::kRight);
+            BuildMiningMachine(board, {row, kWidth - 1}, Direction::kLeft);
+        }
+    }
+
+    // Rows of mining machines alternate with the lanes they feed, so every
+    // lane receives far more than the trunks can carry and, once warmed up,
+    // every conveyor is full and moving at capacity.
+    template <typename TGameBoard>
+    void BuildSaturated(TGameBoard &board, BenchGameManager *sink)
+    {
+        BuildEmpty(board, sink);
+        for (int row = 0; row < kHeight; ++row)
+        {
+            const bool aboveCenter = row < kTop;
+            const bool besideCenter = row >= kTop && row < kBottom;
+            const bool minerRow = !besideCenter && (aboveCenter ? row % 2 == 0 : row % 2 == 1);
+
+            for (int col = 0; col < kWidth; ++col)
+            {
+                const CellPosition position{row, col};
+                const bool trunk = col >= kLeft && col < kRight;
+                if (besideCenter && trunk)
+                    continue;
+                if (minerRow && !trunk)
+                    BuildMiningMachine(board, position, aboveCenter ? Direction::kBottom : Direction::kTop);
+                else
+                    board.template Build<Feis::ConveyorCell>(position, Inward(position));
+            }
+        }
+    }
+
+    // A single conveyor chain snaking through the rows above the collection
+    // center, fed along its first row by a row of mining machines. Returns
+    // the length of the chain.
+    template <typename TGameBoard>
+    int BuildSerpentine(TGameBoard &board, BenchGameManager *sink)
+    {
+        static_assert(kTop % 2 == 0, "the last row of the chain must run toward the center");
+
+        BuildEmpty(board, sink);
+        for (int col = 0; col < kLeft; ++col)
+        {
+            BuildMiningMachine(board, {0, col}, Direction::kBottom);
+        }
+
+        int length = 0;
+        for (int row = 1; row < kTop; ++row)
+        {
+            const bool rightward = row % 2 == 1;
+            for (int col = 0; col < kLeft; ++col)
+            {
+                const bool turn = rightward ? col == kLeft - 1 : col == 0;
+                const Direction direction = turn && row < kTop - 1 ? Direction::kBottom
+                                            : rightward           ? Direction::kRight
+                                                                  : Direction::kLeft;
+                board.template Build<Feis::ConveyorCell>(CellPosition{row, col}, direction);
+                ++length;
+            }
+        }
+        board.template Build<Feis::ConveyorCell>(CellPosition{kTop - 1, kLeft}, Direction::kBottom);
+        return length + 1;
+    }
+
+    // Tiles on which the Build/Remove churn benchmark places cells: every
+    // tile outside the collection center.
+    inline std::vector<CellPosition> FreeTiles()
+    {
+        std::vector<CellPosition> tiles;
+        for (int row = 0; row < kHeight; ++row)
+        {
+            for (int col = 0; col < kWidth; ++col)
+            {
+                if (row >= kTop && row < kBottom && col >= kLeft && col < kRight)
+                    continue;
+                tiles.push_back({row, col});
+            }
+        }
+        return tiles;
+    }
+}
+
+#endif
@@ -52,13 +52,10 @@ public:
     {
         drawer_->DrawRectangle(cellPosition_, sf::Color(128, 0, 0));
 
-        auto numberCell =
-            dynamic_cast<const Feis::NumberCell *>(backgroundCell_);
-
-        if (numberCell)
+        if (cell->GetMinedNumber() != 0)
         {
             drawer_->DrawText(
-                std::to_string(numberCell->GetNumber()),
+                std::to_string(cell->GetMinedNumber()),
                 TGameRendererConfig::kCellSize * 0.8,
                 sf::Color::White,
                 cellPosition_,
@@ -0,0 +1,296 @@
+#ifndef COMBINER_PLANNER_HPP
+#define COMBINER_PLANNER_HPP
+#include "PDOGS.cpp"
+
+#include <array>
+#include <initializer_list>
+#include <tuple>
+#include <vector>
+
+// Plans which NumberCells to mine, alone or combined, so that what reaches
+// the collection center is scored. A source whose number is divisible is
+// mined on its own. The others are grouped by residue modulo the divisor into
+// pairs whose residues cancel, or into trees of two combiners where a third
+// source cancels the residue of a pair. Partners are looked up among the
+// nearest buildable NumberCells of the wanted residue through
+// IGameInfo::GetNumberCellIndex(), and route lengths are read from
+// IGameInfo::GetDistanceToCollectionCenter(), so Compute() is cheap enough
+// to run every action slot.
+//
+// Costs are estimates: the conveyors between sources are taken from their
+// Manhattan distance, ignoring walls between them, and the route from the
+// last combiner from the distance of the source closest to the center.
+template <typename TConfig>
+class BasicCombinerPlanner
+{
+public:
+    using Engine = Feis::BasicEngine<TConfig>;
+    using CellPosition = Feis::CellPosition;
+    using Entry = typename Engine::NumberCellIndex::Entry;
+
+    static constexpr std::size_t kMaxSources = 3;
+    // The player acts every third tick.
+    static constexpr int kTicksPerAction = 3;
+
+    struct Plan
+    {
+        // The NumberCells to mine. With three, the first two are combined and
+        // the result is combined with the third.
+        std::array<CellPosition, kMaxSources> sources;
+        std::size_t sourceCount;
+        // Sum of one product of every source; divisible by the divisor.
+        int sum;
+        // The source closest to the collection center; the last combiner
+        // sits next to it.
+        CellPosition outlet;
+        // Miners, combiners and the estimated conveyors.
+        int buildActions;
+        // Estimated ticks for a product to travel from its miner into the
+        // collection center.
+        int latency;
+        // Products delivered by the end of the game if building starts now.
+        // One product per mining interval once the first one arrives.
+        int expectedDeliveries;
+    };
+
+    // Per source, the pairNeighborCount nearest partners that complete it
+    // are tried, and trees with the treeNeighborCount nearest partners of
+    // each other residue and of the residue that then completes them.
+    explicit BasicCombinerPlanner(std::size_t pairNeighborCount = 4, std::size_t treeNeighborCount = 2)
+        : pairNeighborCount_(pairNeighborCount), treeNeighborCount_(treeNeighborCount)
+    {
+    }
+
+    // Plans for the current board, ranked by expected deliveries, then by
+    // build actions. Plans may share sources; see SelectDisjoint().
+    const std::vector<Plan> &Compute(const typename Engine::IGameInfo &info)
+    {
+        candidates_.clear();
+        plans_.clear();
+        const int divisor = FindDivisor(info);
+        if (divisor == 0)
+            return plans_;
+
+        // Only buildable sources with a route are searched, by residue.
+        sourcesByResidue_.resize(std::max<std::size_t>(sourcesByResidue_.size(), divisor));
+        for (int residue = 0; residue < divisor; ++residue)
+        {
+            sourcesByResidue_[residue].Clear();
+        }
+        for (const Entry &entry : info.GetNumberCellIndex().GetEntries())
+        {
+            if (entry.buildable && info.GetDistanceToCollectionCenter(entry.position) > 0)
+            {
+                sourcesByResidue_[entry.number % divisor].Add(entry.position, entry.number);
+            }
+        }
+
+        for (const Entry &first : sourcesByResidue_[0].GetEntries())
+        {
+            AddPlan(info, {&first});
+        }
+
+        nearest_.resize(divisor);
+        for (int residue = 1; residue < divisor; ++residue)
+        {
+            for (const Entry &first : sourcesByResidue_[residue].GetEntries())
+            {
+                AddCombinedPlans(info, first, divisor);
+            }
+        }
+
+        // Ranks are sorted rather than the plans themselves. The same group
+        // is found from each of its sources, so equal keys are skipped.
+        ranks_.clear();
+        for (std::size_t i = 0; i < candidates_.size(); ++i)
+        {
+            const Plan &plan = candidates_[i];
+            ranks_.push_back({-plan.expectedDeliveries, plan.buildActions, Key(plan), static_cast<int>(i)});
+        }
+        std::sort(ranks_.begin(), ranks_.end());
+        for (std::size_t i = 0; i < ranks_.size(); ++i)
+        {
+            if (i == 0 || std::get<2>(ranks_[i]) != std::get<2>(ranks_[i - 1]))
+                plans_.push_back(candidates_[std::get<3>(ranks_[i])]);
+        }
+        return plans_;
+    }
+
+    const std::vector<Plan> &GetPlans() const
+    {
+        return plans_;
+    }
+
+    // Up to count plans of Compute() in rank order, skipping any plan that
+    // shares a source with one taken before it.
+    std::vector<Plan> SelectDisjoint(std::size_t count) const
+    {
+        std::vector<Plan> selected;
+        std::vector<CellPosition> used;
+        for (const Plan &plan : plans_)
+        {
+            if (selected.size() == count)
+                break;
+
+            bool disjoint = true;
+            for (std::size_t i = 0; i < plan.sourceCount; ++i)
+            {
+                disjoint = disjoint && std::find(used.begin(), used.end(), plan.sources[i]) == used.end();
+            }
+            if (!disjoint)
+                continue;
+
+            selected.push_back(plan);
+            used.insert(used.end(), plan.sources.begin(), plan.sources.begin() + plan.sourceCount);
+        }
+        return selected;
+    }
+
+    // The smallest positive number that is scored, or 0 if there is none
+    // below 2^16.
+    static int FindDivisor(const typename Engine::IGameInfo &info)
+    {
+        for (int number = 1; number < (1 << 16); ++number)
+        {
+            if (info.IsScoredProduct(number))
+                return number;
+        }
+        return 0;
+    }
+
+private:
+    static constexpr int kKeyBits = 21;
+    static_assert(TConfig::kBoardWidth * TConfig::kBoardHeight < (1 << kKeyBits) - 1, "tiles must fit in a plan key");
+
+    // The tiles of the sources, plus one, in a canonical order: the pair
+    // combined first is sorted. Equal keys mean equal plans.
+    static std::uint64_t Key(const Plan &plan)
+    {
+        std::array<std::uint64_t, kMaxSources> tiles{};
+        for (std::size_t i = 0; i < plan.sourceCount; ++i)
+        {
+            tiles[i] = ToIndex(plan.sources[i]) + 1;
+        }
+        if (tiles[1] < tiles[0])
+        {
+            std::swap(tiles[0], tiles[1]);
+        }
+        return tiles[0] << (2 * kKeyBits) | tiles[1] << kKeyBits | tiles[2];
+    }
+
+    static int ToIndex(CellPosition cellPosition)
+    {
+        return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+    }
+
+    static int Manhattan(CellPosition a, CellPosition b)
+    {
+        return std::abs(a.row - b.row) + std::abs(a.col - b.col);
+    }
+
+    // Conveyors to bring the products of two sources into the two tiles of
+    // a combiner placed between them.
+    static int FeederConveyors(CellPosition a, CellPosition b)
+    {
+        return std::max(0, Manhattan(a, b) - 2);
+    }
+
+    // Pairs and trees with first, whose residue is not 0.
+    void AddCombinedPlans(const typename Engine::IGameInfo &info, const Entry &first, int divisor)
+    {
+        const int residue = first.number % divisor;
+
+        // One extra partner of each residue in case a tree needs two.
+        const std::size_t count = std::max(pairNeighborCount_, treeNeighborCount_ + 1);
+        for (int other = 1; other < divisor; ++other)
+        {
+            nearest_[other] = sourcesByResidue_[other].FindNearest(
+                first.position, count, [&](const Entry &entry) { return entry.position != first.position; });
+        }
+
+        const std::vector<const Entry *> &partners = nearest_[divisor - residue];
+        for (std::size_t i = 0; i < partners.size() && i < pairNeighborCount_; ++i)
+        {
+            AddPlan(info, {&first, partners[i]});
+        }
+
+        for (int other = 1; other < divisor; ++other)
+        {
+            if ((residue + other) % divisor == 0)
+                continue;
+
+            const std::vector<const Entry *> &closers = nearest_[divisor - (residue + other) % divisor];
+            for (std::size_t i = 0; i < nearest_[other].size() && i < treeNeighborCount_; ++i)
+            {
+                const Entry *second = nearest_[other][i];
+                std::size_t added = 0;
+                for (std::size_t j = 0; j < closers.size() && added < treeNeighborCount_; ++j)
+                {
+                    if (closers[j] != second)
+                    {
+                        AddPlan(info, {&first, second, closers[j]});
+                        ++added;
+                    }
+                }
+            }
+        }
+    }
+
+    void AddPlan(const typename Engine::IGameInfo &info, std::initializer_list<const Entry *> sources)
+    {
+        Plan plan{};
+        plan.sourceCount = sources.size();
+        int feeders = 0;
+        int outletDistance = 0;
+        std::size_t i = 0;
+        for (const Entry *source : sources)
+        {
+            plan.sources[i] = source->position;
+            plan.sum += source->number;
+
+            const int distance = info.GetDistanceToCollectionCenter(source->position);
+            if (i++ == 0 || distance < outletDistance ||
+                (distance == outletDistance && ToIndex(source->position) < ToIndex(plan.outlet)))
+            {
+                plan.outlet = source->position;
+                outletDistance = distance;
+            }
+        }
+        if (plan.sourceCount >= 2)
+        {
+            feeders += FeederConveyors(plan.sources[0], plan.sources[1]);
+        }
+        if (plan.sourceCount == 3)
+        {
+            feeders += std::min(FeederConveyors(plan.sources[0], plan.sources[2]),
+                                FeederConveyors(plan.sources[1], plan.sources[2]));
+        }
+
+        // The miner at the outlet outputs into a tile one step closer.
+        const int combiners = static_cast<int>(plan.sourceCount) - 1;
+        const int route = outletDistance - 1;
+        plan.buildActions = static_cast<int>(plan.sourceCount) + combiners + feeders + route;
+        plan.latency = (feeders + combiners + route + 1) * static_cast<int>(TConfig::kConveyorBufferSize);
+
+        const int remaining = info.GetEndTime() - info.GetElapsedTime();
+        const int firstDelivery = kTicksPerAction * plan.buildActions + static_cast<int>(TConfig::kMiningInterval) + plan.latency;
+        plan.expectedDeliveries =
+            remaining < firstDelivery ? 0 : 1 + (remaining - firstDelivery) / static_cast<int>(TConfig::kMiningInterval);
+        candidates_.push_back(plan);
+    }
+
+    std::size_t pairNeighborCount_;
+    std::size_t treeNeighborCount_;
+    std::vector<Plan> candidates_;
+    // -expectedDeliveries, buildActions, key and index into candidates_.
+    std::vector<std::tuple<int, int, std::uint64_t, int>> ranks_;
+    std::vector<Plan> plans_;
+    // Usable sources by residue, and the ones nearest to the source being
+    // planned for, rebuilt by every Compute().
+    std::vector<typename Engine::NumberCellIndex> sourcesByResidue_;
+    std::vector<std::vector<const Entry *>> nearest_;
+};
+
+using CombinerPlanner = BasicCombinerPlanner<Feis::GameManagerConfig>;
+
+#endif
@@ -0,0 +1,351 @@
+#ifndef DIFFERENTIAL_CHECK_HPP
+#define DIFFERENTIAL_CHECK_HPP
+#include "PDOGS.cpp"
+
+#include "GreedyPlayer.hpp"
+#include "MctsPlayer.hpp"
+#include "SweepRunner.hpp"
+
+#include <limits>
+#include <string>
+#include <vector>
+
+// Plays the same games on every engine and checks that they agree tick by
+// tick. Every engine replays one script per game: GreedyPlayer's actions, a few
+// of MctsPlayer's combiner pair projects, then a tail that clears and rebuilds
+// some of the cells, every combiner among them, so that removals are covered
+// too. Divisor 1 games get no pairs, as every number is scored alone. The reference is GameBoard in SchedulingMode::kEveryTick. Each
+// engine is also checked through a Fork() and a LoadCheckpoint() taken halfway
+// through the script, and by its final scores when fast-forwarded. GameBoard
+// engines are compared by GetStateHash(). The other boards hash GetState()
+// instead, so they are compared with the same hash of the reference's state.
+class DifferentialCheck
+{
+public:
+    struct Mismatch
+    {
+        std::string engine;
+        // "play", "fork", "checkpoint" or "fast-forward".
+        std::string run;
+        int commonDivisor;
+        unsigned int seed;
+        // First tick at which the run disagrees with the reference.
+        int tick;
+    };
+
+    explicit DifferentialCheck(std::size_t threadCount) : pool_(threadCount)
+    {
+    }
+
+    static const std::vector<std::string> &GetEngineNames()
+    {
+        static const std::vector<std::string> names = {
+            "object", "event", "parallel", "pipelined", "flat", "variant", "chunked"};
+        return names;
+    }
+
+    // Returns the first mismatch of every (game, engine, run) that has one.
+    std::vector<Mismatch> Run(const std::vector<int> &commonDivisors, unsigned int firstSeed, unsigned int lastSeed)
+    {
+        std::vector<Game> games;
+        for (int commonDivisor : commonDivisors)
+        {
+            for (unsigned int seed = firstSeed; seed <= lastSeed; ++seed)
+            {
+                games.push_back({commonDivisor, seed, {}, {}, 0});
+            }
+        }
+
+        std::vector<std::vector<Mismatch>> mismatchesOfGame(games.size());
+        pool_.Run(games.size(), [&games, &mismatchesOfGame](std::size_t, std::size_t index) {
+            Game &game = games[index];
+            Prepare(game);
+
+            std::vector<Mismatch> &mismatches = mismatchesOfGame[index];
+            CheckEngine<Feis::GameBoard>("object", Feis::SchedulingMode::kEveryTick, game, mismatches);
+            CheckEngine<Feis::GameBoard>("event", Feis::SchedulingMode::kEventDriven, game, mismatches);
+            CheckEngine<Feis::GameBoard>("parallel", Feis::SchedulingMode::kParallel, game, mismatches);
+            CheckEngine<Feis::GameBoard>("pipelined", Feis::SchedulingMode::kPipelined, game, mismatches);
+            CheckEngine<Feis::FlatGameBoard>("flat", Feis::SchedulingMode::kEveryTick, game, mismatches);
+            CheckEngine<Feis::VariantGameBoard>("variant", Feis::SchedulingMode::kEveryTick, game, mismatches);
+            CheckEngine<Feis::ChunkedGameBoard>("chunked", Feis::SchedulingMode::kEveryTick, game, mismatches);
+
+            game.script.clear();
+            game.trace.clear();
+        });
+
+        std::vector<Mismatch> mismatches;
+        for (const std::vector<Mismatch> &gameMismatches : mismatchesOfGame)
+        {
+            mismatches.insert(mismatches.end(), gameMismatches.begin(), gameMismatches.end());
+        }
+        return mismatches;
+    }
+
+    std::size_t GetThreadCount() const
+    {
+        return pool_.GetThreadCount();
+    }
+
+private:
+    using Script = std::vector<Feis::PlayerAction>;
+
+    struct Tick
+    {
+        int scores;
+        std::uint64_t stateHash;
+        // Feis::HashState() of the reference's GetState().
+        std::uint64_t serializedStateHash;
+    };
+
+    struct Game
+    {
+        int commonDivisor;
+        unsigned int seed;
+        Script script;
+        // trace[t - 1] is the reference after tick t.
+        std::vector<Tick> trace;
+        int splitTick;
+    };
+
+    // Plays a script without looking at the board. The manager asks for an
+    // action on every third tick, so the tick alone locates it in the script.
+    class ScriptedPlayer : public Feis::IGamePlayer
+    {
+    public:
+        explicit ScriptedPlayer(const Script &script) : script_(script), next_(0)
+        {
+        }
+
+        Feis::PlayerAction GetNextAction(const Feis::IGameInfo &info) override
+        {
+            const std::size_t index = info.GetElapsedTime() / 3 - 1;
+            next_ = index + 1;
+            if (index < script_.size())
+                return script_[index];
+            return {Feis::PlayerActionType::None, {0, 0}};
+        }
+
+        bool IsFinished() const override
+        {
+            return next_ >= script_.size();
+        }
+
+    private:
+        const Script &script_;
+        std::size_t next_;
+    };
+
+    // Combiner pairs laid out after GreedyPlayer's actions.
+    static constexpr std::size_t kCombinerPairs = 4;
+    // Clears and rebuilds one in kChurnStride of the scripted cells and every
+    // combiner once the builds are done, kChurnGap actions apart.
+    static constexpr std::size_t kChurnStride = 5;
+    static constexpr std::size_t kChurnGap = 10;
+    // Threads of each kParallel game; the games already run side by side.
+    static constexpr std::size_t kParallelThreads = 2;
+
+    static void Prepare(Game &game)
+    {
+        // GreedyPlayer plans on its first call and ignores the board afterwards,
+        // so its actions can be drained from a fresh game.
+        auto probe = std::make_unique<Feis::GameManager>(nullptr, game.commonDivisor, game.seed);
+        GreedyPlayer greedy;
+        do
+        {
+            game.script.push_back(greedy.GetNextAction(*probe));
+        } while (!greedy.IsFinished());
+        AddCombinerPairs(game);
+
+        const std::size_t builds = game.script.size();
+        std::size_t combiners = 0;
+        for (std::size_t i = 0; i < builds; ++i)
+        {
+            const Feis::PlayerAction build = game.script[i];
+            const bool combiner = IsCombiner(build.type);
+            if (build.type == Feis::PlayerActionType::None || (i % kChurnStride != 0 && !combiner))
+                continue;
+
+            // Every other combiner is cleared through its second tile.
+            Feis::CellPosition cleared = build.cellPosition;
+            if (combiner && combiners++ % 2 == 1)
+                cleared += GetSecondCombinerTile(build.type);
+            game.script.push_back({Feis::PlayerActionType::Clear, cleared});
+            game.script.insert(game.script.end(), kChurnGap - 1, {Feis::PlayerActionType::None, {0, 0}});
+            game.script.push_back(build);
+        }
+        game.splitTick = std::min(static_cast<int>(game.script.size() / 2 * 3 + 1),
+                                  static_cast<int>(Feis::GameManagerConfig::kEndTime) - 1);
+
+        ScriptedPlayer player(game.script);
+        auto reference = std::make_unique<Feis::GameManager>(&player, game.commonDivisor, game.seed);
+        while (!reference->IsGameOver())
+        {
+            reference->Update();
+            game.trace.push_back({reference->GetScores(), reference->GetStateHash(), HashSerializedState(*reference)});
+        }
+    }
+
+    // Appends MctsPlayer's best pair project, planned on the board the script
+    // leaves so far, kCombinerPairs times or until none is left.
+    static void AddCombinerPairs(Game &game)
+    {
+        ScriptedPlayer player(game.script);
+        auto probe = std::make_unique<Feis::GameManager>(&player, game.commonDivisor, game.seed);
+        MctsPlayer::ProjectGenerator generator;
+        for (std::size_t pairs = 0; pairs < kCombinerPairs; ++pairs)
+        {
+            const int scriptEnd = static_cast<int>(game.script.size() + 1) * 3;
+            while (!probe->IsGameOver() && probe->GetElapsedTime() < scriptEnd)
+            {
+                probe->Update();
+            }
+            if (probe->IsGameOver())
+                return;
+
+            const auto &projects = generator.Generate(*probe, std::numeric_limits<std::size_t>::max());
+            const auto pair = std::find_if(projects.begin(), projects.end(), [](const MctsPlayer::Project &project) {
+                return std::any_of(project.actions.begin(), project.actions.end(),
+                                   [](const Feis::PlayerAction &action) { return IsCombiner(action.type); });
+            });
+            if (pair == projects.end())
+                return;
+
+            game.script.insert(game.script.end(), pair->actions.begin(), pair->actions.end());
+        }
+    }
+
+    static bool IsCombiner(Feis::PlayerActionType type)
+    {
+        return type >= Feis::PlayerActionType::BuildTopOutCombiner && type <= Feis::PlayerActionType::BuildLeftOutCombiner;
+    }
+
+    // Offset of a combiner's second tile from the one it is built at: below
+    // it for left and right outputs, right of it otherwise.
+    static Feis::CellPosition GetSecondCombinerTile(Feis::PlayerActionType type)
+    {
+        if (type == Feis::PlayerActionType::BuildLeftOutCombiner || type == Feis::PlayerActionType::BuildRightOutCombiner)
+            return {1, 0};
+        return {0, 1};
+    }
+
+    // The board state ends a checkpoint, after the cells and the clock.
+    static std::uint64_t HashSerializedState(Feis::GameManager &game)
+    {
+        std::vector<int> checkpoint;
+        game.SaveCheckpoint(checkpoint);
+        const std::size_t clockOffset = 3 + 3 * static_cast<std::size_t>(checkpoint[2]);
+        const std::size_t stateOffset = clockOffset + 1 + static_cast<std::size_t>(checkpoint[clockOffset]);
+        return Feis::HashState(std::vector<int>(checkpoint.begin() + stateOffset, checkpoint.end()));
+    }
+
+    template <typename TGameBoard>
+    static bool Agrees(Feis::BasicGameManager<TGameBoard> &game, const Game &reference)
+    {
+        const Tick &expected = reference.trace[game.GetElapsedTime() - 1];
+        if (game.GetScores() != expected.scores)
+            return false;
+        if constexpr (std::is_same<TGameBoard, Feis::GameBoard>::value)
+            return game.GetStateHash() == expected.stateHash;
+        else
+            return game.GetStateHash() == expected.serializedStateHash;
+    }
+
+    template <typename TGameBoard>
+    static std::unique_ptr<Feis::BasicGameManager<TGameBoard>> MakeGame(
+        Feis::IGamePlayer *player, Feis::SchedulingMode mode, const Game &game)
+    {
+        auto gameManager = std::make_unique<Feis::BasicGameManager<TGameBoard>>(player, game.commonDivisor, game.seed);
+        if constexpr (std::is_same<TGameBoard, Feis::GameBoard>::value)
+        {
+            gameManager->SetSchedulingMode(mode);
+            gameManager->SetThreadCount(kParallelThreads);
+        }
+        return gameManager;
+    }
+
+    template <typename TGameBoard>
+    static void CheckEngine(const std::string &engine, Feis::SchedulingMode mode, const Game &game,
+                            std::vector<Mismatch> &mismatches)
+    {
+        auto report = [&](const char *run, int tick) {
+            mismatches.push_back({engine, run, game.commonDivisor, game.seed, tick});
+        };
+
+        // The played game forks itself at splitTick and both play on.
+        {
+            ScriptedPlayer player(game.script);
+            ScriptedPlayer forkPlayer(game.script);
+            auto played = MakeGame<TGameBoard>(&player, mode, game);
+            std::unique_ptr<Feis::BasicGameManager<TGameBoard>> fork;
+            int playMismatch = 0;
+            int forkMismatch = 0;
+            while (!played->IsGameOver())
+            {
+                played->Update();
+                if (playMismatch == 0 && !Agrees(*played, game))
+                    playMismatch = played->GetElapsedTime();
+
+                if (fork != nullptr)
+                {
+                    fork->Update();
+                    if (forkMismatch == 0 && !Agrees(*fork, game))
+                        forkMismatch = fork->GetElapsedTime();
+                }
+                else if (played->GetElapsedTime() == game.splitTick)
+                {
+                    fork = played->Fork(&forkPlayer);
+                    if (!Agrees(*fork, game))
+                        forkMismatch = game.splitTick;
+                }
+            }
+            if (playMismatch != 0)
+                report("play", playMismatch);
+            if (forkMismatch != 0)
+                report("fork", forkMismatch);
+        }
+
+        // A game resumed at splitTick from a checkpoint of the played one.
+        {
+            ScriptedPlayer player(game.script);
+            auto played = MakeGame<TGameBoard>(&player, mode, game);
+            while (played->GetElapsedTime() < game.splitTick)
+            {
+                played->Update();
+            }
+            std::vector<int> checkpoint;
+            played->SaveCheckpoint(checkpoint);
+            played = nullptr;
+
+            ScriptedPlayer resumedPlayer(game.script);
+            auto resumed = MakeGame<TGameBoard>(&resumedPlayer, mode, game);
+            int mismatch = 0;
+            if (!resumed->LoadCheckpoint(checkpoint) || !Agrees(*resumed, game))
+                mismatch = game.splitTick;
+            while (mismatch == 0 && !resumed->IsGameOver())
+            {
+                resumed->Update();
+                if (!Agrees(*resumed, game))
+                    mismatch = resumed->GetElapsedTime();
+            }
+            if (mismatch != 0)
+                report("checkpoint", mismatch);
+        }
+
+        // Only the final scores survive fast-forwarding.
+        {
+            ScriptedPlayer player(game.script);
+            auto played = MakeGame<TGameBoard>(&player, mode, game);
+            played->SetFastForward(true);
+            while (!played->IsGameOver())
+            {
+                played->Update();
+            }
+            if (played->GetScores() != game.trace.back().scores)
+                report("fast-forward", played->GetElapsedTime());
+        }
+    }
+
+    WorkStealingPool pool_;
+};
+#endif
@@ -5,6 +5,7 @@
 
 #include "PDOGS.cpp"
 
+#include "ActionLog.hpp"
 #include "GameRenderer.hpp"
 
 using namespace Feis;
@@ -50,18 +51,6 @@ private:
     std::queue<PlayerAction> actions_;
 };
 
-void Save(std::queue<PlayerAction> playerActionHistory, const std::string &filename)
-{
-    std::ofstream outFile(filename);
-    while (!playerActionHistory.empty())
-    {
-        const PlayerAction &playerAction = playerActionHistory.front();
-        outFile << playerAction.cellPosition.row << " " << playerAction.cellPosition.col << " " << static_cast<int>(playerAction.type) << std::endl;
-        playerActionHistory.pop();
-    }
-}
-
-
 int main(int, char **)
 {
     sf::VideoMode mode = sf::VideoMode(1280, 1024);
@@ -71,8 +60,16 @@ int main(int, char **)
     window.setFramerateLimit(GameRendererConfig::kFPS);
 
     GamePlayerWithHistory player;
-    
-    GameManager gameManager(&player, 1, 20);
+
+    constexpr int kCommonDivisor = 1;
+    constexpr unsigned int kSeed = 20;
+
+    // Every applied action is streamed to the log; F4 flushes it to disk.
+    std::ofstream logFile("gameplay.pdal", std::ios::binary);
+    ActionLogWriter logWriter(logFile, {kCommonDivisor, kSeed});
+    ActionLogRecorder recorder(&player, &logWriter);
+
+    GameManager gameManager(&recorder, kCommonDivisor, kSeed);
 
     const std::map<sf::Keyboard::Key, PlayerActionType> playerActionKeyboardMap = {
         {sf::Keyboard::J, PlayerActionType::BuildLeftOutMiningMachine},
@@ -94,8 +91,6 @@ int main(int, char **)
 
     GameRenderer<GameRendererConfig> gameRenderer(&window);
 
-    std::queue<PlayerAction> playerActionHistory;
-
     while (window.isOpen())
     {
         sf::Event event;
@@ -111,7 +106,6 @@ int main(int, char **)
                     {
                         auto playerAction = PlayerAction{playerActionType, mouseCellPosition};
                         player.EnqueueAction(playerAction);
-                        playerActionHistory.push(playerAction);
                     }
                 }
             }
@@ -124,7 +118,7 @@ int main(int, char **)
                 } 
                 else if (event.key.code == sf::Keyboard::F4)
                 {
-                    Save(playerActionHistory, "gameplay.txt");
+                    logWriter.Flush();
                 }
             }
             if (event.type == sf::Event::Closed)
@@ -0,0 +1,165 @@
+#ifndef GREEDY_PLAYER_HPP
+#define GREEDY_PLAYER_HPP
+#include "PDOGS.cpp"
+
+#include <deque>
+
+// Reference player that keeps all of its state in the instance, so that any
+// number of games can run side by side. It lays straight conveyor lanes out
+// of the collection center (two per side) and puts a mining machine on every
+// scored NumberCell next to a lane, then reports IsFinished().
+class GreedyPlayer : public Feis::IGamePlayer
+{
+public:
+    using CellPosition = Feis::CellPosition;
+    using Direction = Feis::Direction;
+    using PlayerAction = Feis::PlayerAction;
+    using PlayerActionType = Feis::PlayerActionType;
+
+    PlayerAction GetNextAction(const Feis::IGameInfo &info) override
+    {
+        if (!planned_)
+        {
+            Plan(info);
+            planned_ = true;
+        }
+
+        if (actions_.empty())
+        {
+            return {PlayerActionType::None, {0, 0}};
+        }
+
+        PlayerAction action = actions_.front();
+        actions_.pop_front();
+        return action;
+    }
+
+    bool IsFinished() const override
+    {
+        return planned_ && actions_.empty();
+    }
+
+private:
+    struct Lane
+    {
+        CellPosition start;
+        Direction outward;
+        bool ended;
+    };
+
+    void Plan(const Feis::IGameInfo &info)
+    {
+        using Config = Feis::GameManager::CollectionCenterConfig;
+        const int top = Config::kTop;
+        const int left = Config::kLeft;
+        const int last = static_cast<int>(Feis::GameManagerConfig::kGoalSize) - 1;
+
+        commonDivisor_ = std::stoi(info.GetLevelInfo().substr(1));
+
+        std::vector<Lane> lanes = {
+            {{top, left - 1}, Direction::kLeft, false},
+            {{top + last, left - 1}, Direction::kLeft, false},
+            {{top, left + last + 1}, Direction::kRight, false},
+            {{top + last, left + last + 1}, Direction::kRight, false},
+            {{top - 1, left}, Direction::kTop, false},
+            {{top - 1, left + last}, Direction::kTop, false},
+            {{top + last + 1, left}, Direction::kBottom, false},
+            {{top + last + 1, left + last}, Direction::kBottom, false},
+        };
+
+        for (int distance = 0; distance < Feis::GameManagerConfig::kBoardWidth; ++distance)
+        {
+            for (Lane &lane : lanes)
+            {
+                if (lane.ended)
+                    continue;
+
+                CellPosition position = lane.start;
+                for (int k = 0; k < distance; ++k)
+                {
+                    position = Feis::GetNeighborCellPosition(position, lane.outward);
+                }
+
+                if (!Feis::IsWithinBoard(position) || !info.GetLayeredCell(position).CanBuild())
+                {
+                    lane.ended = true;
+                    continue;
+                }
+
+                actions_.push_back({GetConveyorAction(Reverse(lane.outward)), position});
+
+                for (Direction side : {TurnLeft(lane.outward), TurnRight(lane.outward)})
+                {
+                    CellPosition minerPosition = Feis::GetNeighborCellPosition(position, side);
+                    if (IsScoredNumberCell(info, minerPosition))
+                    {
+                        actions_.push_back({GetMiningMachineAction(Reverse(side)), minerPosition});
+                    }
+                }
+            }
+        }
+    }
+
+    bool IsScoredNumberCell(const Feis::IGameInfo &info, CellPosition position) const
+    {
+        if (!Feis::IsWithinBoard(position))
+            return false;
+
+        const Feis::LayeredCell &layeredCell = info.GetLayeredCell(position);
+        auto numberCell = dynamic_cast<const Feis::NumberCell *>(layeredCell.GetBackground().get());
+
+        return numberCell && layeredCell.CanBuild() && numberCell->GetNumber() % commonDivisor_ == 0;
+    }
+
+    static Direction Reverse(Direction direction)
+    {
+        return static_cast<Direction>((static_cast<int>(direction) + 2) % 4);
+    }
+
+    static Direction TurnLeft(Direction direction)
+    {
+        return static_cast<Direction>((static_cast<int>(direction) + 3) % 4);
+    }
+
+    static Direction TurnRight(Direction direction)
+    {
+        return static_cast<Direction>((static_cast<int>(direction) + 1) % 4);
+    }
+
+    static PlayerActionType GetConveyorAction(Direction direction)
+    {
+        switch (direction)
+        {
+        case Direction::kTop:
+            return PlayerActionType::BuildBottomToTopConveyor;
+        case Direction::kRight:
+            return PlayerActionType::BuildLeftToRightConveyor;
+        case Direction::kBottom:
+            return PlayerActionType::BuildTopToBottomConveyor;
+        case Direction::kLeft:
+            return PlayerActionType::BuildRightToLeftConveyor;
+        }
+        return PlayerActionType::None;
+    }
+
+    static PlayerActionType GetMiningMachineAction(Direction direction)
+    {
+        switch (direction)
+        {
+        case Direction::kTop:
+            return PlayerActionType::BuildTopOutMiningMachine;
+        case Direction::kRight:
+            return PlayerActionType::BuildRightOutMiningMachine;
+        case Direction::kBottom:
+            return PlayerActionType::BuildBottomOutMiningMachine;
+        case Direction::kLeft:
+            return PlayerActionType::BuildLeftOutMiningMachine;
+        }
+        return PlayerActionType::None;
+    }
+
+    std::deque<PlayerAction> actions_;
+    int commonDivisor_ = 1;
+    bool planned_ = false;
+};
+#endif
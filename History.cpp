@@ -1,48 +1,83 @@
-#include "PDOGS.hpp"
+#define USE_ENGINE_ONLY
+#include "PDOGS.cpp"
+
+#include "ActionLog.hpp"
+#include "Replay.hpp"
 
-#include <iostream>
 #include <fstream>
+#include <iostream>
 
 using namespace Feis;
 
-class GamePlayerWithHistory : public IGamePlayer
+// Usage: History [gameplay.pdal] [--at TICK]
+//
+// Replays an action log recorded by the GUI on the level stored in its header
+// and prints the final scores, or the scores at TICK. Seeking uses the
+// checkpoints in gameplay.pdal.ckpt, which are written on first use.
+int main(int argc, char **argv)
 {
-public:
-    GamePlayerWithHistory(const std::string &filename)
+    std::string filename = "gameplay.pdal";
+    int tick = -1;
+    for (int i = 1; i < argc; ++i)
     {
-        std::ifstream inFile(filename);
-        PlayerAction action;
-        int type;
-        while (inFile >> action.cellPosition.row >> action.cellPosition.col >> type)
+        const std::string arg = argv[i];
+        if (arg == "--at" && i + 1 < argc)
+        {
+            tick = std::stoi(argv[++i]);
+        }
+        else
         {
-            action.type = static_cast<PlayerActionType>(type);
-            actions_.push(action);
+            filename = arg;
         }
     }
 
-    PlayerAction GetNextAction(const IGameInfo& info) 
+    MappedFile file(filename);
+    ActionLogReader reader(file.GetData(), file.GetSize());
+    if (!reader.IsValid())
+    {
+        std::cerr << filename << " is not an action log" << std::endl;
+        return 1;
+    }
+
+    ActionLogReader scan = reader;
+    ActionLogRecord record;
+    while (scan.Next(record))
+    {
+    }
+    if (scan.IsMalformed())
+    {
+        std::cerr << filename << " has a malformed record at offset " << scan.GetPosition().offset << std::endl;
+        return 1;
+    }
+
+    if (tick >= 0)
     {
-        if (actions_.empty())
+        ReplayEngine replay(reader);
+        const std::string checkpointFilename = filename + ".ckpt";
+        bool loaded;
         {
-            return {PlayerActionType::None, {0, 0}};
+            MappedFile checkpointFile(checkpointFilename);
+            loaded = replay.LoadCheckpoints(checkpointFile.GetData(), checkpointFile.GetSize());
         }
-        const auto action = actions_.front();
-        actions_.pop();
-        return action;
+        if (!loaded)
+        {
+            replay.BuildCheckpoints();
+            std::ofstream out(checkpointFilename, std::ios::binary);
+            replay.WriteCheckpoints(out);
+        }
+
+        std::cout << replay.Seek(tick).GetScores() << std::endl;
+        return 0;
     }
-private:
-    std::queue<PlayerAction> actions_;
-};
 
-int main()
-{
-    GamePlayerWithHistory player("gameplay.txt");
-    GameManager gameManager(&player, 3, 20);
+    ActionLogPlayer player(reader);
+    GameManager gameManager(&player, reader.GetHeader().commonDivisor, reader.GetHeader().seed);
+    gameManager.SetFastForward(true);
 
     while (!gameManager.IsGameOver())
     {
         gameManager.Update();
     }
-    
+
     std::cout << gameManager.GetScores() << std::endl;
-}
\ No newline at end of file
+}
@@ -0,0 +1,798 @@
+#ifndef MCTS_PLAYER_HPP
+#define MCTS_PLAYER_HPP
+#include "PDOGS.cpp"
+
+#include "CombinerPlanner.hpp"
+#include "Routing.hpp"
+#include "ThroughputModel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Reference player that searches instead of following a fixed plan. Its
+// moves are projects: a miner on a scored NumberCell with the conveyors that
+// take its products to the collection center or to a conveyor already
+// leading there, or two miners whose sum is scored feeding a combiner
+// (pairs from BasicCombinerPlanner). Whenever the previous project is laid
+// out, each search thread forks the game and grows its own Monte Carlo tree
+// over the candidate projects, plus stopping, for as many iterations as fit
+// in the time budget (root parallelization). The threads are kept between
+// decisions. An iteration plays the projects along the tree
+// path on its fork, a project per step, rolls out a few more chosen at random
+// among the best candidates, and scores the leaf with the final scores
+// BasicThroughputModel predicts for it. The most visited project over all
+// trees is laid out, one action per call, which is exactly the every third
+// tick cadence of the real game; forks apply an action and update three
+// ticks.
+//
+// The search needs GetNextAction() to be given the manager itself, to fork
+// it. Any other IGameInfo gets the best candidate by expected deliveries.
+template <typename TConfig, typename TGameBoard = typename Feis::BasicEngine<TConfig>::GameBoard>
+class BasicMctsPlayer : public Feis::BasicEngine<TConfig>::IGamePlayer
+{
+public:
+    using Engine = Feis::BasicEngine<TConfig>;
+    using GameManager = typename Engine::template BasicGameManager<TGameBoard>;
+    using CellPosition = Feis::CellPosition;
+    using Direction = Feis::Direction;
+    using PlayerAction = Feis::PlayerAction;
+    using PlayerActionType = Feis::PlayerActionType;
+
+    static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+    static constexpr int kTicksPerAction = 3;
+
+    struct Options
+    {
+        // Wall-clock time of each decision, candidate listing included. No
+        // iteration is started that would likely overrun it; if none fits,
+        // the best candidate by expected deliveries is laid out.
+        std::chrono::milliseconds timeBudget{20};
+        // Search threads, one tree each; 0 for one per core.
+        std::size_t threadCount = 0;
+        // Projects considered in every state, best expected deliveries first.
+        std::size_t candidateCount = 8;
+        // Projects added after a new leaf before it is scored.
+        std::size_t rolloutDepth = 2;
+        // The rollouts choose among this many of the best candidates.
+        std::size_t rolloutWidth = 3;
+        // UCT exploration constant, on values scaled to [0, 1].
+        double exploration = 0.5;
+        unsigned int seed = 0;
+    };
+
+    explicit BasicMctsPlayer(Options options = Options())
+        : options_(WithThreadCount(options)), pool_(options_.threadCount)
+    {
+        searchers_.reserve(options_.threadCount);
+        for (std::size_t i = 0; i < options_.threadCount; ++i)
+        {
+            searchers_.emplace_back(options_, options_.seed + static_cast<unsigned int>(i));
+        }
+    }
+
+    PlayerAction GetNextAction(const typename Engine::IGameInfo &info) override
+    {
+        if (actions_.empty() && !finished_)
+        {
+            Decide(info);
+        }
+
+        if (actions_.empty())
+        {
+            return {PlayerActionType::None, {0, 0}};
+        }
+
+        PlayerAction action = actions_.front();
+        actions_.pop_front();
+        return action;
+    }
+
+    bool IsFinished() const override
+    {
+        return finished_ && actions_.empty();
+    }
+
+    // Search iterations of the last decision, summed over all threads.
+    std::size_t GetLastIterations() const
+    {
+        return lastIterations_;
+    }
+
+    struct Project
+    {
+        // Miners first, so that they start mining while the rest is built.
+        std::vector<PlayerAction> actions;
+        // Products delivered by the end of the game, estimated.
+        int expectedDeliveries;
+    };
+
+    // Lists the candidate projects of a board. Routes come from a
+    // TrunkRouter: they follow the board's distance field to the collection
+    // center, or end at a conveyor that reaches it through conveyors only.
+    // DifferentialCheck scripts combiners from its pair projects.
+    class ProjectGenerator
+    {
+    public:
+        ProjectGenerator() : feederDistance_(kTileCount), feederParent_(kTileCount), feederStamp_(kTileCount)
+        {
+        }
+
+        // Up to count projects, best expected deliveries first, then fewest
+        // actions.
+        const std::vector<Project> &Generate(const typename Engine::IGameInfo &info, std::size_t count)
+        {
+            projects_.clear();
+            miners_.clear();
+            router_.Reset(info);
+
+            for (const auto &entry : info.GetNumberCellIndex().GetEntries())
+            {
+                if (entry.buildable && info.IsScoredProduct(entry.number))
+                {
+                    AddMinerCandidate(info, entry.position);
+                }
+            }
+
+            // Only the miners that can make the cut get their routes laid out.
+            const std::size_t kept = std::min(count, miners_.size());
+            std::partial_sort(miners_.begin(), miners_.begin() + kept, miners_.end(),
+                              [](const MinerCandidate &a, const MinerCandidate &b) {
+                                  if (a.expectedDeliveries != b.expectedDeliveries)
+                                      return a.expectedDeliveries > b.expectedDeliveries;
+                                  return a.actionCount < b.actionCount;
+                              });
+            for (std::size_t i = 0; i < kept; ++i)
+            {
+                AddMinerProject(miners_[i]);
+            }
+
+            if (CombinerPlanner::FindDivisor(info) > 1)
+            {
+                const auto &plans = planner_.Compute(info);
+                std::size_t pairs = 0;
+                for (const auto &plan : plans)
+                {
+                    if (pairs == kPairPlans)
+                        break;
+                    if (plan.sourceCount != 2)
+                        continue;
+
+                    AddPairProject(info, plan.sources[0], plan.sources[1]);
+                    ++pairs;
+                }
+            }
+
+            std::sort(projects_.begin(), projects_.end(), [](const Project &a, const Project &b) {
+                if (a.expectedDeliveries != b.expectedDeliveries)
+                    return a.expectedDeliveries > b.expectedDeliveries;
+                return a.actions.size() < b.actions.size();
+            });
+            while (!projects_.empty() && projects_.back().expectedDeliveries == 0)
+            {
+                projects_.pop_back();
+            }
+            if (projects_.size() > count)
+            {
+                projects_.resize(count);
+            }
+            return projects_;
+        }
+
+    private:
+        using CombinerPlanner = BasicCombinerPlanner<TConfig>;
+        using TrunkRouter = BasicTrunkRouter<TConfig>;
+
+        // A miner project before its route is laid out.
+        struct MinerCandidate
+        {
+            CellPosition source;
+            int output;
+            std::size_t actionCount;
+            int expectedDeliveries;
+        };
+
+        // Pairs of the planner tried per board.
+        static constexpr std::size_t kPairPlans = 16;
+        // Longest conveyor line from the second miner of a pair to the combiner.
+        static constexpr int kMaxFeederLength = 12;
+
+        // The reachable neighbor of position closest to a route end, or -1,
+        // and its distance to that end.
+        int FindOutput(CellPosition position, int &distance) const
+        {
+            int best = -1;
+            for (int k = 0; k < 4; ++k)
+            {
+                const CellPosition neighbor = Feis::GetNeighborCellPosition(position, static_cast<Direction>(k));
+                const int neighborDistance = router_.GetDistance(neighbor);
+                if (neighborDistance != TrunkRouter::kUnreachable && (best < 0 || neighborDistance < distance))
+                {
+                    best = ToTile(neighbor);
+                    distance = neighborDistance;
+                }
+            }
+            return best;
+        }
+
+        // Conveyors from tile to the end of its route; false if the route
+        // crosses one of the avoided tiles or there is none.
+        bool AppendRoute(int tile, std::initializer_list<int> avoided, std::vector<PlayerAction> &actions)
+        {
+            steps_.clear();
+            if (!router_.AppendRoute(ToPosition(tile), steps_))
+                return false;
+
+            for (const auto &step : steps_)
+            {
+                if (std::find(avoided.begin(), avoided.end(), ToTile(step.position)) != avoided.end())
+                    return false;
+
+                actions.push_back({GetConveyorAction(step.direction), step.position});
+            }
+            return true;
+        }
+
+        // The miner and one conveyor per step of its route.
+        void AddMinerCandidate(const typename Engine::IGameInfo &info, CellPosition source)
+        {
+            int distance = 0;
+            const int output = FindOutput(source, distance);
+            if (output < 0)
+                return;
+
+            const std::size_t actionCount = 1 + static_cast<std::size_t>(distance);
+            miners_.push_back({source, output, actionCount, ExpectedDeliveries(info, actionCount, actionCount)});
+        }
+
+        void AddMinerProject(const MinerCandidate &miner)
+        {
+            Project project;
+            project.actions.push_back(
+                {GetMiningMachineAction(DirectionTo(miner.source, ToPosition(miner.output))), miner.source});
+            AppendRoute(miner.output, {}, project.actions);
+            project.expectedDeliveries = miner.expectedDeliveries;
+            projects_.push_back(std::move(project));
+        }
+
+        // Tries both sources as the one that feeds the combiner directly, in
+        // every orientation around it, and keeps the fewest actions.
+        void AddPairProject(const typename Engine::IGameInfo &info, CellPosition first, CellPosition second)
+        {
+            Project best;
+            int bestHops = 0;
+            for (int order = 0; order < 2; ++order)
+            {
+                const CellPosition a = order == 0 ? first : second;
+                const CellPosition b = order == 0 ? second : first;
+                SearchFeeders(info, a, b);
+
+                for (int k = 0; k < 4; ++k)
+                {
+                    const CellPosition main = Feis::GetNeighborCellPosition(a, static_cast<Direction>(k));
+                    if (!Engine::IsWithinBoard(main) || main == b || !info.GetLayeredCell(main).CanBuild())
+                        continue;
+
+                    for (int d = 0; d < 4; ++d)
+                    {
+                        Project project;
+                        int hops = 0;
+                        if (LayOutPair(info, a, b, main, static_cast<Direction>(d), project, hops) &&
+                            (best.actions.empty() || project.actions.size() < best.actions.size()))
+                        {
+                            best = std::move(project);
+                            bestHops = hops;
+                        }
+                    }
+                }
+            }
+
+            if (best.actions.empty())
+                return;
+
+            best.expectedDeliveries = ExpectedDeliveries(info, best.actions.size(), bestHops);
+            projects_.push_back(std::move(best));
+        }
+
+        // Breadth-first search over buildable tiles from the neighbors of b,
+        // which source a does not block, for the conveyors into the combiner.
+        void SearchFeeders(const typename Engine::IGameInfo &info, CellPosition a, CellPosition b)
+        {
+            ++feederGeneration_;
+            queue_.clear();
+            for (int k = 0; k < 4; ++k)
+            {
+                const CellPosition neighbor = Feis::GetNeighborCellPosition(b, static_cast<Direction>(k));
+                if (Engine::IsWithinBoard(neighbor) && neighbor != a && info.GetLayeredCell(neighbor).CanBuild())
+                {
+                    VisitFeeder(ToTile(neighbor), 1, -1);
+                }
+            }
+
+            for (std::size_t head = 0; head < queue_.size(); ++head)
+            {
+                const int tile = queue_[head];
+                if (feederDistance_[tile] == kMaxFeederLength)
+                    continue;
+
+                for (int k = 0; k < 4; ++k)
+                {
+                    const CellPosition neighbor = Feis::GetNeighborCellPosition(ToPosition(tile), static_cast<Direction>(k));
+                    if (Engine::IsWithinBoard(neighbor) && neighbor != a && feederStamp_[ToTile(neighbor)] != feederGeneration_ &&
+                        info.GetLayeredCell(neighbor).CanBuild())
+                    {
+                        VisitFeeder(ToTile(neighbor), feederDistance_[tile] + 1, tile);
+                    }
+                }
+            }
+        }
+
+        void VisitFeeder(int tile, int distance, int parent)
+        {
+            feederStamp_[tile] = feederGeneration_;
+            feederDistance_[tile] = distance;
+            feederParent_[tile] = parent;
+            queue_.push_back(tile);
+        }
+
+        // The combiner that takes the products of a into main and outputs
+        // towards output; the products of b come through the feeder conveyors
+        // found by SearchFeeders().
+        bool LayOutPair(const typename Engine::IGameInfo &info, CellPosition a, CellPosition b, CellPosition main,
+                        Direction output, Project &project, int &hops)
+        {
+            // The first tile of a combiner outputs for kBottom and kLeft, the
+            // second one for kTop and kRight.
+            const bool vertical = output == Direction::kLeft || output == Direction::kRight;
+            const CellPosition step = vertical ? CellPosition{1, 0} : CellPosition{0, 1};
+            const bool mainFirst = output == Direction::kBottom || output == Direction::kLeft;
+            const CellPosition topLeft = mainFirst ? main : main + CellPosition{-step.row, -step.col};
+            const CellPosition other = mainFirst ? main + step : topLeft;
+            if (!Engine::IsWithinBoard(other) || other == a || other == b || !info.GetLayeredCell(other).CanBuild())
+                return false;
+
+            const CellPosition next = Feis::GetNeighborCellPosition(main, output);
+            if (!Engine::IsWithinBoard(next) || next == a || next == b || next == other)
+                return false;
+
+            const int nextTile = ToTile(next);
+            std::vector<PlayerAction> route;
+            if (!AppendRoute(nextTile, {ToTile(a), ToTile(b), ToTile(main), ToTile(other)}, route))
+                return false;
+
+            std::vector<PlayerAction> feeders;
+            CellPosition bOutput = other;
+            if (Manhattan(b, other) != 1)
+            {
+                int last = -1;
+                for (int k = 0; k < 4; ++k)
+                {
+                    const CellPosition neighbor = Feis::GetNeighborCellPosition(other, static_cast<Direction>(k));
+                    if (!Engine::IsWithinBoard(neighbor))
+                        continue;
+
+                    const int tile = ToTile(neighbor);
+                    if (feederStamp_[tile] == feederGeneration_ && neighbor != main && tile != nextTile &&
+                        (last < 0 || feederDistance_[tile] < feederDistance_[last]))
+                    {
+                        last = tile;
+                    }
+                }
+                if (last < 0)
+                    return false;
+
+                CellPosition target = other;
+                for (int tile = last; tile >= 0; tile = feederParent_[tile])
+                {
+                    const CellPosition position = ToPosition(tile);
+                    if (position == main || position == other || tile == nextTile || OnRoute(route, position))
+                        return false;
+
+                    feeders.push_back({GetConveyorAction(DirectionTo(position, target)), position});
+                    target = position;
+                }
+                std::reverse(feeders.begin(), feeders.end());
+                bOutput = target;
+            }
+
+            project.actions.push_back({GetMiningMachineAction(DirectionTo(a, main)), a});
+            project.actions.push_back({GetMiningMachineAction(DirectionTo(b, bOutput)), b});
+            project.actions.insert(project.actions.end(), feeders.begin(), feeders.end());
+            project.actions.push_back({GetCombinerAction(output), topLeft});
+            project.actions.insert(project.actions.end(), route.begin(), route.end());
+            hops = static_cast<int>(feeders.size() + route.size()) + 2;
+            return true;
+        }
+
+        static bool OnRoute(const std::vector<PlayerAction> &route, CellPosition position)
+        {
+            return std::any_of(route.begin(), route.end(),
+                               [&](const PlayerAction &action) { return action.cellPosition == position; });
+        }
+
+        // Deliveries once the project is laid out, one action every third
+        // tick, if its products spend a conveyor delay on each of hops.
+        static int ExpectedDeliveries(const typename Engine::IGameInfo &info, std::size_t actions, std::size_t hops)
+        {
+            const int interval = static_cast<int>(TConfig::kMiningInterval);
+            const int latency = static_cast<int>(hops) * static_cast<int>(TConfig::kConveyorBufferSize);
+            const int remaining = info.GetEndTime() - info.GetElapsedTime();
+            const int firstDelivery = kTicksPerAction * static_cast<int>(actions) + interval + latency;
+            return remaining < firstDelivery ? 0 : 1 + (remaining - firstDelivery) / interval;
+        }
+
+        TrunkRouter router_;
+        std::vector<typename TrunkRouter::Step> steps_;
+        std::vector<int> queue_;
+        std::vector<int> feederDistance_;
+        std::vector<int> feederParent_;
+        std::vector<unsigned int> feederStamp_;
+        unsigned int feederGeneration_ = 0;
+        CombinerPlanner planner_;
+        std::vector<MinerCandidate> miners_;
+        std::vector<Project> projects_;
+    };
+
+private:
+    struct TreeNode
+    {
+        // The candidates of the node's state, then stopping; set on the
+        // first visit.
+        std::vector<Project> projects;
+        // Per candidate and stopping, the node it leads to, or -1.
+        std::vector<int> children;
+        int visits = 0;
+        double valueSum = 0;
+        bool expanded = false;
+        // Nothing more is built after this node.
+        bool stopped = false;
+    };
+
+    // One search thread: its tree, its forks and its own random numbers.
+    class Searcher
+    {
+    public:
+        Searcher(const Options &options, unsigned int seed)
+            : options_(options), random_(seed)
+        {
+        }
+
+        // Iterates until the next iteration would likely end after deadline,
+        // judging by the mean and spread of the cost of the iterations so
+        // far. That may be none at all.
+        void Run(const GameManager &root, const std::vector<Project> &projects,
+                 std::chrono::steady_clock::time_point deadline)
+        {
+            nodes_.assign(1, TreeNode());
+            nodes_[0].projects = projects;
+            nodes_[0].children.assign(projects.size() + 1, -1);
+            nodes_[0].expanded = true;
+            iterations_ = 0;
+            minValue_ = 0;
+            maxValue_ = 0;
+
+            for (auto start = std::chrono::steady_clock::now(); start + iterationCost_ + 2 * iterationSpread_ < deadline;)
+            {
+                Iterate(root);
+                ++iterations_;
+                const auto end = std::chrono::steady_clock::now();
+                if (iterationCost_ == std::chrono::steady_clock::duration::zero())
+                {
+                    iterationCost_ = end - start;
+                }
+                // Exponential moving averages over the last eight or so.
+                const auto deviation = end - start - iterationCost_;
+                iterationCost_ += deviation / 8;
+                iterationSpread_ += (std::chrono::abs(deviation) - iterationSpread_) / 8;
+                start = end;
+            }
+        }
+
+        const std::vector<TreeNode> &GetNodes() const
+        {
+            return nodes_;
+        }
+
+        std::size_t GetIterations() const
+        {
+            return iterations_;
+        }
+
+    private:
+        void Iterate(const GameManager &root)
+        {
+            std::unique_ptr<GameManager> game = root.Fork();
+            game->SetFastForward(false);
+
+            path_.assign(1, 0);
+            int node = 0;
+            while (!nodes_[node].stopped && !game->IsGameOver())
+            {
+                if (!nodes_[node].expanded)
+                {
+                    const std::vector<Project> &projects = generator_.Generate(*game, options_.candidateCount);
+                    nodes_[node].projects = projects;
+                    nodes_[node].children.assign(projects.size() + 1, -1);
+                    nodes_[node].expanded = true;
+                    break;
+                }
+
+                const std::size_t choice = Select(node);
+                if (nodes_[node].children[choice] < 0)
+                {
+                    nodes_[node].children[choice] = static_cast<int>(nodes_.size());
+                    TreeNode child;
+                    child.stopped = choice == nodes_[node].projects.size();
+                    nodes_.push_back(std::move(child));
+                }
+                if (choice < nodes_[node].projects.size())
+                {
+                    Play(*game, nodes_[node].projects[choice]);
+                }
+                node = nodes_[node].children[choice];
+                path_.push_back(node);
+            }
+
+            if (!nodes_[node].stopped)
+            {
+                for (std::size_t step = 0; step < options_.rolloutDepth && !game->IsGameOver(); ++step)
+                {
+                    const std::vector<Project> &projects = generator_.Generate(*game, options_.rolloutWidth);
+                    if (projects.empty())
+                        break;
+
+                    Play(*game, projects[std::uniform_int_distribution<std::size_t>(0, projects.size() - 1)(random_)]);
+                }
+            }
+
+            const double value = model_.Compute(*game).predictedScores;
+            if (iterations_ == 0)
+            {
+                minValue_ = maxValue_ = value;
+            }
+            minValue_ = std::min(minValue_, value);
+            maxValue_ = std::max(maxValue_, value);
+            for (int visited : path_)
+            {
+                ++nodes_[visited].visits;
+                nodes_[visited].valueSum += value;
+            }
+        }
+
+        // UCT over the children of node; unvisited ones first, in random order.
+        std::size_t Select(int node)
+        {
+            const TreeNode &current = nodes_[node];
+            const double range = maxValue_ - minValue_;
+            const double logVisits = std::log(static_cast<double>(std::max(current.visits, 1)));
+            std::size_t best = 0;
+            double bestScore = -1;
+            std::size_t unvisited = 0;
+            for (std::size_t i = 0; i < current.children.size(); ++i)
+            {
+                const int child = current.children[i];
+                if (child < 0 || nodes_[child].visits == 0)
+                {
+                    // Reservoir sampling among the unvisited children.
+                    if (std::uniform_int_distribution<std::size_t>(0, unvisited++)(random_) == 0)
+                    {
+                        best = i;
+                    }
+                    continue;
+                }
+                if (unvisited > 0)
+                    continue;
+
+                const TreeNode &visited = nodes_[child];
+                const double mean = visited.valueSum / visited.visits;
+                const double exploitation = range > 0 ? (mean - minValue_) / range : 0.5;
+                const double score = exploitation + options_.exploration * std::sqrt(logVisits / visited.visits);
+                if (score > bestScore)
+                {
+                    best = i;
+                    bestScore = score;
+                }
+            }
+            return best;
+        }
+
+        Options options_;
+        std::mt19937 random_;
+        ProjectGenerator generator_;
+        BasicThroughputModel<TConfig> model_;
+        std::vector<TreeNode> nodes_;
+        std::vector<int> path_;
+        std::size_t iterations_ = 0;
+        // Kept across decisions, so the first iteration of one is judged too;
+        // only the player's very first iteration runs unjudged.
+        std::chrono::steady_clock::duration iterationCost_{};
+        std::chrono::steady_clock::duration iterationSpread_{};
+        double minValue_ = 0;
+        double maxValue_ = 0;
+    };
+
+    static Options WithThreadCount(Options options)
+    {
+        if (options.threadCount == 0)
+        {
+            options.threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return options;
+    }
+
+    void Decide(const typename Engine::IGameInfo &info)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + options_.timeBudget;
+        const std::vector<Project> &projects = generator_.Generate(info, options_.candidateCount);
+        lastIterations_ = 0;
+        if (projects.empty())
+        {
+            finished_ = true;
+            return;
+        }
+
+        auto root = dynamic_cast<const GameManager *>(&info);
+        if (root == nullptr || options_.timeBudget.count() <= 0)
+        {
+            actions_.assign(projects.front().actions.begin(), projects.front().actions.end());
+            return;
+        }
+
+        pool_.Run(searchers_.size(), [&](std::size_t i) { searchers_[i].Run(*root, projects, deadline); });
+
+        // The trees share their root candidates, so visits add up by index.
+        std::vector<int> visits(projects.size() + 1);
+        std::vector<double> values(projects.size() + 1);
+        for (const Searcher &searcher : searchers_)
+        {
+            lastIterations_ += searcher.GetIterations();
+            const TreeNode &tree = searcher.GetNodes().front();
+            for (std::size_t i = 0; i < tree.children.size(); ++i)
+            {
+                if (tree.children[i] < 0)
+                    continue;
+
+                const TreeNode &child = searcher.GetNodes()[tree.children[i]];
+                visits[i] += child.visits;
+                values[i] += child.valueSum;
+            }
+        }
+
+        // Until every choice has been tried, the counts say little; the first
+        // candidate is laid out, as without any search.
+        std::size_t best = 0;
+        const bool triedAll = std::count(visits.begin(), visits.end(), 0) == 0;
+        for (std::size_t i = 1; triedAll && i < visits.size(); ++i)
+        {
+            if (visits[i] > visits[best] ||
+                (visits[i] == visits[best] && visits[i] > 0 && values[i] / visits[i] > values[best] / visits[best]))
+            {
+                best = i;
+            }
+        }
+
+        if (best == projects.size())
+        {
+            finished_ = true;
+            return;
+        }
+        actions_.assign(projects[best].actions.begin(), projects[best].actions.end());
+    }
+
+    // Lays out project on a fork as the real game would: an action, then the
+    // three ticks until the next one.
+    static void Play(GameManager &game, const Project &project)
+    {
+        for (const PlayerAction &action : project.actions)
+        {
+            game.ApplyAction(action);
+            for (int tick = 0; tick < kTicksPerAction && !game.IsGameOver(); ++tick)
+            {
+                game.Update();
+            }
+            if (game.IsGameOver())
+                return;
+        }
+    }
+
+    static int ToTile(CellPosition cellPosition)
+    {
+        return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+    }
+
+    static CellPosition ToPosition(int tile)
+    {
+        return {tile / TConfig::kBoardWidth, tile % TConfig::kBoardWidth};
+    }
+
+    static int Manhattan(CellPosition a, CellPosition b)
+    {
+        return std::abs(a.row - b.row) + std::abs(a.col - b.col);
+    }
+
+    static bool IsCollectionCenter(CellPosition cellPosition)
+    {
+        using CollectionCenterConfig = typename GameManager::CollectionCenterConfig;
+        return cellPosition.row >= CollectionCenterConfig::kTop &&
+               cellPosition.row < CollectionCenterConfig::kTop + static_cast<int>(TConfig::kGoalSize) &&
+               cellPosition.col >= CollectionCenterConfig::kLeft &&
+               cellPosition.col < CollectionCenterConfig::kLeft + static_cast<int>(TConfig::kGoalSize);
+    }
+
+    // The direction from a to its neighbor b.
+    static Direction DirectionTo(CellPosition a, CellPosition b)
+    {
+        if (b.row < a.row)
+            return Direction::kTop;
+        if (b.col > a.col)
+            return Direction::kRight;
+        if (b.row > a.row)
+            return Direction::kBottom;
+        return Direction::kLeft;
+    }
+
+    static PlayerActionType GetConveyorAction(Direction direction)
+    {
+        switch (direction)
+        {
+        case Direction::kTop:
+            return PlayerActionType::BuildBottomToTopConveyor;
+        case Direction::kRight:
+            return PlayerActionType::BuildLeftToRightConveyor;
+        case Direction::kBottom:
+            return PlayerActionType::BuildTopToBottomConveyor;
+        case Direction::kLeft:
+            return PlayerActionType::BuildRightToLeftConveyor;
+        }
+        return PlayerActionType::None;
+    }
+
+    static PlayerActionType GetMiningMachineAction(Direction direction)
+    {
+        switch (direction)
+        {
+        case Direction::kTop:
+            return PlayerActionType::BuildTopOutMiningMachine;
+        case Direction::kRight:
+            return PlayerActionType::BuildRightOutMiningMachine;
+        case Direction::kBottom:
+            return PlayerActionType::BuildBottomOutMiningMachine;
+        case Direction::kLeft:
+            return PlayerActionType::BuildLeftOutMiningMachine;
+        }
+        return PlayerActionType::None;
+    }
+
+    static PlayerActionType GetCombinerAction(Direction direction)
+    {
+        switch (direction)
+        {
+        case Direction::kTop:
+            return PlayerActionType::BuildTopOutCombiner;
+        case Direction::kRight:
+            return PlayerActionType::BuildRightOutCombiner;
+        case Direction::kBottom:
+            return PlayerActionType::BuildBottomOutCombiner;
+        case Direction::kLeft:
+            return PlayerActionType::BuildLeftOutCombiner;
+        }
+        return PlayerActionType::None;
+    }
+
+    Options options_;
+    ProjectGenerator generator_;
+    std::vector<Searcher> searchers_;
+    // The caller runs one searcher, the pool's threads the others.
+    Feis::UpdateWorkerPool pool_;
+    std::deque<PlayerAction> actions_;
+    std::size_t lastIterations_ = 0;
+    bool finished_ = false;
+};
+
+using MctsPlayer = BasicMctsPlayer<Feis::GameManagerConfig>;
+
+#endif
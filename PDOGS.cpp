@@ -6,12 +6,33 @@
 #include <queue>
 #include <functional>
 #include <cassert>
+#include <cstddef>
 #include <set>
 #include <array>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <variant>
+#include <type_traits>
+#include <chrono>
+#include <iomanip>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#ifdef PDOGS_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 
 namespace Feis
 {
+    // The course map. Any type with these members can configure a
+    // BasicEngine.
     struct GameManagerConfig
     {
         static constexpr int kBoardWidth = 62;
@@ -19,6 +40,7 @@ namespace Feis
         static constexpr std::size_t kGoalSize = 4;
         static constexpr std::size_t kConveyorBufferSize = 10;
         static constexpr int kNumberOfWalls = 100;
+        static constexpr std::size_t kMiningInterval = 100;
         static constexpr std::size_t kEndTime = 9000;
     };
 
@@ -57,96 +79,70 @@ namespace Feis
         kLeft = 3
     };
 
-    class GameBoard;
-
-    class LayeredCell;
-
-
-    class IGameInfo
-    {
-    public:
-        virtual std::string GetLevelInfo() const = 0;
-        virtual const LayeredCell &GetLayeredCell(CellPosition cellPosition) const = 0;
-        virtual bool IsScoredProduct(int number) const = 0;
-        virtual int GetScores() const = 0;
-        virtual int GetEndTime() const = 0;
-        virtual int GetElapsedTime() const = 0;
-        virtual bool IsGameOver() const = 0;
-    };
-
-    class IGameManager : public IGameInfo
+    enum class SchedulingMode
     {
-    public:
-        virtual void OnProductReceived(int number) = 0;
+        kEveryTick,
+        kEventDriven,
+        kParallel,
+        kPipelined
     };
 
-    class Cell;
-
-    class NumberCell;
-    class CollectionCenterCell;
-    class MiningMachineCell;
-    class ConveyorCell;
-    class CombinerCell;
-    class WallCell;
-
-    class CellVisitor
+    enum class CellAllocation
     {
-    public:
-        virtual void Visit(const NumberCell *cell) const {}
-        virtual void Visit(const CollectionCenterCell *cell) const  {}
-        virtual void Visit(const MiningMachineCell *cell) const  {}
-        virtual void Visit(const ConveyorCell *cell) const  {}
-        virtual void Visit(const CombinerCell *cell) const  {}
-        virtual void Visit(const WallCell *cell) const  {}
+        kHeap,
+        kArena
     };
 
-    class Cell
+    // SplitMix64 finalizer. Spreads structured keys (tile, slot, value) over
+    // all 64 bits, so Zobrist keys are computed instead of stored in tables.
+    inline std::uint64_t MixHash(std::uint64_t x)
     {
-    public:
-        virtual void Accept(const CellVisitor *visitor) const = 0;
-        virtual ~Cell() {}
-    };
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
 
-    class IBackgroundCell : public Cell
+    // FNV-1a over a serialized state, for boards without an incremental hash.
+    inline std::uint64_t HashState(const std::vector<int> &state)
     {
-    public:
-        virtual bool CanBuild() const = 0;
-        virtual ~IBackgroundCell() {}
-    };
+        std::uint64_t hash = 14695981039346656037ull;
+        for (int value : state)
+        {
+            hash = (hash ^ static_cast<std::uint32_t>(value)) * 1099511628211ull;
+        }
+        return hash;
+    }
 
-    class ForegroundCell : public Cell
+    inline int CountTrailingZeros(std::uint64_t bits)
     {
-    public:
-        ForegroundCell(CellPosition topLeftCellPosition) : topLeftCellPosition_(topLeftCellPosition) {}
-
-        virtual std::size_t GetWidth() const { return 1; }
-
-        virtual std::size_t GetHeight() const { return 1; }
-
-        virtual CellPosition GetTopLeftCellPosition() const { return topLeftCellPosition_; }
-
-        virtual bool CanRemove() const { return false; }
-
-        virtual std::size_t GetCapacity(CellPosition cellPosition) const { return 0; }
-
-        virtual void ReceiveProduct(CellPosition cellPosition, int number) { }
-
-        virtual void UpdatePassOne(CellPosition cellPosition, GameBoard &board) { }
-
-        virtual void UpdatePassTwo(CellPosition cellPosition, GameBoard &board) { }
-
-        virtual ~ForegroundCell() {}
-
-    protected:
-        CellPosition topLeftCellPosition_;
-    };
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(bits);
+#else
+        int count = 0;
+        while ((bits & 1) == 0)
+        {
+            bits >>= 1;
+            ++count;
+        }
+        return count;
+#endif
+    }
 
-    class ICellRenderer
+    inline int FindLastSet(std::uint64_t bits)
     {
-    public:
-        virtual void RenderPassOne(CellPosition position) const = 0;
-        virtual void RenderPassTwo(CellPosition position) const = 0;
-    };
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(bits);
+#else
+        int index = -1;
+        while (bits != 0)
+        {
+            bits >>= 1;
+            ++index;
+        }
+        return index;
+#endif
+    }
 
     CellPosition GetNeighborCellPosition(CellPosition cellPosition, Direction direction)
     {
@@ -165,672 +161,4460 @@ namespace Feis
         return {0, 0};
     }
 
-    std::size_t GetNeighborCapacity(const GameBoard &board, CellPosition cellPosition, Direction direction);
-
-    void SendProduct(GameBoard &board, CellPosition cellPosition, Direction direction, int product);
-
-    class ConveyorCell : public ForegroundCell
+    // Bump allocator for the cells of one game. Nothing is freed
+    // individually; Reset() rewinds to the first chunk so the next game
+    // reuses the same memory without going through the global allocator.
+    class CellArena
     {
     public:
-        ConveyorCell(CellPosition topLeftCellPosition, Direction direction)
-            : ForegroundCell(topLeftCellPosition),  products_{}, direction_{direction} {}
-
-        int GetProduct(std::size_t i) const { return products_[i]; }
+        static constexpr std::size_t kChunkSize = 64 * 1024;
 
-        std::size_t GetProductCount() const { return products_.size(); }
+        CellArena() : chunkIndex_{}, used_{} {}
 
-        Direction GetDirection() const { return direction_; }
-
-        void Accept(const CellVisitor *visitor) const override
-        {
-            visitor->Visit(this);
-        }
+        CellArena(const CellArena &) = delete;
+        CellArena &operator=(const CellArena &) = delete;
 
-        bool CanRemove() const override
+        void *Allocate(std::size_t size, std::size_t alignment)
         {
-            return true;
-        }
+            assert(alignment <= alignof(std::max_align_t));
 
-        std::size_t GetCapacity(CellPosition cellPosition) const override
-        {
-            for (std::size_t i = 0; i < products_.size(); ++i)
+            std::size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+            while (chunkIndex_ >= chunks_.size() || offset + size > chunks_[chunkIndex_].size)
             {
-                if (products_[products_.size() - 1 - i] != 0)
+                if (chunkIndex_ < chunks_.size())
                 {
-                    return i;
+                    ++chunkIndex_;
                 }
-            }
-            return products_.size();
-        }
-
-        void ReceiveProduct(CellPosition cellPosition, int number) override
-        {
-            assert(number != 0);
-            assert(products_.back() == 0);
-            products_.back() = number;
-        }
-
-        void UpdatePassOne(CellPosition cellPosition, GameBoard &board) override
-        {
-            std::size_t capacity = GetNeighborCapacity(board, cellPosition, direction_);
-
-            if (capacity >= 3)
-            {
-                if (products_[0] != 0)
+                if (chunkIndex_ == chunks_.size())
                 {
-                    SendProduct(board, cellPosition, direction_, products_[0]);
-                    products_[0] = 0;
+                    const std::size_t chunkSize = std::max(kChunkSize, size);
+                    chunks_.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[chunkSize]), chunkSize});
                 }
+                offset = 0;
             }
 
-            if (capacity >= 2)
-            {
-                if (products_[0] == 0 && products_[1] != 0)
-                {
-                    std::swap(products_[0], products_[1]);
-                }
-            }
+            used_ = offset + size;
+            return chunks_[chunkIndex_].data.get() + offset;
+        }
 
-            if (capacity >= 1)
-            {
-                if (products_[0] == 0 && products_[1] == 0 && products_[2] != 0)
-                {
-                    std::swap(products_[1], products_[2]);
-                }
-            }
+        // Every cell allocated from the arena must have been destroyed.
+        void Reset()
+        {
+            chunkIndex_ = 0;
+            used_ = 0;
         }
 
-        void UpdatePassTwo(CellPosition cellPosition, GameBoard &board) override
+        std::size_t GetReservedBytes() const
         {
-            for (std::size_t k = 3; k < products_.size(); ++k)
+            std::size_t bytes = 0;
+            for (const Chunk &chunk : chunks_)
             {
-                if (products_[k] != 0 && products_[k - 1] == 0 && products_[k - 2] == 0 && products_[k - 3] == 0)
-                {
-                    std::swap(products_[k], products_[k - 1]);
-                }
+                bytes += chunk.size;
             }
+            return bytes;
         }
 
-    protected:
-        std::array<int, GameManagerConfig::kConveyorBufferSize> products_;
-
     private:
-        Direction direction_;
+        struct Chunk
+        {
+            std::unique_ptr<unsigned char[]> data;
+            std::size_t size;
+        };
+
+        std::vector<Chunk> chunks_;
+        std::size_t chunkIndex_;
+        std::size_t used_;
     };
 
-    class CombinerCell : public ForegroundCell
+    template <typename T>
+    class ArenaAllocator
     {
     public:
-        CombinerCell(CellPosition topLeft, Direction direction)
-            : ForegroundCell(topLeft), direction_{direction}, firstSlotProduct_{}, secondSlotProduct_{} {}
-
-        Direction GetDirection() const { return direction_; }
+        using value_type = T;
 
-        int GetFirstSlotProduct() const { return firstSlotProduct_; }
+        explicit ArenaAllocator(CellArena *arena) : arena_(arena) {}
 
-        int GetSecondSlotProduct() const { return secondSlotProduct_; }
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.GetArena()) {}
 
-        void Accept(const CellVisitor *visitor) const override
+        T *allocate(std::size_t n)
         {
-            visitor->Visit(this);
+            return static_cast<T *>(arena_->Allocate(n * sizeof(T), alignof(T)));
         }
 
-        std::size_t GetWidth() const override
-        {
-            return direction_ == Direction::kTop || direction_ == Direction::kBottom ? 2 : 1;
-        }
+        void deallocate(T *, std::size_t) {}
 
-        std::size_t GetHeight() const override
+        CellArena *GetArena() const { return arena_; }
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U> &other) const { return arena_ == other.GetArena(); }
+
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U> &other) const { return arena_ != other.GetArena(); }
+
+    private:
+        CellArena *arena_;
+    };
+
+    // Allocates a cell (and its shared_ptr control block) from the arena, or
+    // from the heap when arena is null.
+    template <typename TCell, typename... TArgs>
+    std::shared_ptr<TCell> MakeCell(CellArena *arena, TArgs &&...args)
+    {
+        if (arena)
         {
-            return direction_ == Direction::kTop || direction_ == Direction::kBottom ? 1 : 2;
+            return std::allocate_shared<TCell>(ArenaAllocator<TCell>(arena), std::forward<TArgs>(args)...);
         }
+        return std::make_shared<TCell>(std::forward<TArgs>(args)...);
+    }
 
-        bool CanRemove() const override
+    // Engine instrumentation, compiled in with -DPDOGS_PROFILE. Without it
+    // the hooks are empty inline functions and every counter stays 0.
+    struct EngineProfile
+    {
+#ifdef PDOGS_PROFILE
+        static constexpr bool kEnabled = true;
+#else
+        static constexpr bool kEnabled = false;
+#endif
+
+        enum CellType
         {
-            return true;
-        }
+            kConveyor,
+            kCombiner,
+            kMiningMachine,
+            kOtherCell,
+            kCellTypeCount
+        };
 
-        bool IsMainCell(CellPosition cellPosition) const
+        enum Pass
         {
-            switch (direction_)
-            {
-            case Direction::kTop:
-            case Direction::kRight:
-                return cellPosition != ForegroundCell::topLeftCellPosition_;
-            case Direction::kBottom:
-            case Direction::kLeft:
-                return cellPosition == ForegroundCell::topLeftCellPosition_;
-            }
-            assert(false);
-            return false;
-        }
+            kPassOne,
+            kPassTwo,
+            kPassCount
+        };
 
-        std::size_t GetCapacity(CellPosition cellPosition) const override
+        struct Counter
         {
-            if (IsMainCell(cellPosition))
+            std::uint64_t calls = 0;
+            std::uint64_t cycles = 0;
+            std::uint64_t maxCycles = 0;
+
+            void Add(std::uint64_t elapsed)
             {
-                if (firstSlotProduct_ == 0)
-                {
-                    return GameManagerConfig::kConveyorBufferSize;
-                }
-                return 0;
+                ++calls;
+                cycles += elapsed;
+                maxCycles = std::max(maxCycles, elapsed);
             }
 
-            if (secondSlotProduct_ == 0)
+            double GetCyclesPerCall() const
             {
-                return GameManagerConfig::kConveyorBufferSize;
+                return calls == 0 ? 0 : static_cast<double>(cycles) / calls;
             }
-            return 0;
-        }
+        };
 
-        void ReceiveProduct(CellPosition cellPosition, int number) override
+        // Per cell type and pass; only collected by GameBoard.
+        std::array<std::array<Counter, kPassCount>, kCellTypeCount> cellPasses;
+        // IGamePlayer::GetNextAction.
+        Counter player;
+        // One board Update() per tick, fast-forwarded ticks excluded.
+        Counter boardUpdate;
+        std::uint64_t ticks = 0;
+        std::uint64_t updateNanoseconds = 0;
+        // Products delivered from one cell to another.
+        std::uint64_t productsMoved = 0;
+
+        double GetTicksPerSecond() const
         {
-            assert(number != 0);
+            return updateNanoseconds == 0 ? 0 : ticks * 1e9 / updateNanoseconds;
+        }
 
-            if (IsMainCell(cellPosition))
-            {
-                firstSlotProduct_ = number;
-            }
-            else
-            {
-                secondSlotProduct_ = number;
-            }
+        static const char *GetCellTypeName(CellType type)
+        {
+            static const char *const kNames[] = {"conveyor", "combiner", "mining machine", "other"};
+            return kNames[type];
         }
 
-        void UpdatePassOne(CellPosition cellPosition, GameBoard &board) override
+        void Dump(std::ostream &out) const
         {
-            if (!IsMainCell(cellPosition))
+            if (!kEnabled)
+            {
+                out << "profile: not compiled in (build with -DPDOGS_PROFILE)\n";
                 return;
+            }
 
-            if (firstSlotProduct_ != 0 && secondSlotProduct_ != 0)
+            out << std::fixed << std::setprecision(1);
+            out << "ticks " << ticks << "  ticks/sec " << GetTicksPerSecond() << "  products moved " << productsMoved
+                << "\n";
+            DumpCounter(out, "player", player);
+            DumpCounter(out, "board update", boardUpdate);
+            for (int type = 0; type < kCellTypeCount; ++type)
             {
-                if (GetNeighborCapacity(board, cellPosition, direction_) >= 3)
+                for (int pass = 0; pass < kPassCount; ++pass)
                 {
-                    SendProduct(board, cellPosition, direction_, firstSlotProduct_ + secondSlotProduct_);
-                    firstSlotProduct_ = 0;
-                    secondSlotProduct_ = 0;
+                    const Counter &counter = cellPasses[type][pass];
+                    if (counter.calls == 0)
+                        continue;
+                    DumpCounter(out, std::string(GetCellTypeName(static_cast<CellType>(type))) +
+                                         (pass == kPassOne ? " pass one" : " pass two"),
+                                counter);
                 }
             }
+            out << std::defaultfloat;
         }
-    private:
-        Direction direction_;
-        int firstSlotProduct_;
-        int secondSlotProduct_;
-    };
-
-    class WallCell : public ForegroundCell
-    {
-    public:
-        WallCell(CellPosition topLeft) : ForegroundCell(topLeft) {}
 
-        bool CanRemove() const override
-        {
-            return false;
-        }
-        void Accept(const CellVisitor *visitor) const override
+    private:
+        static void DumpCounter(std::ostream &out, const std::string &name, const Counter &counter)
         {
-            visitor->Visit(this);
+            out << std::left << std::setw(26) << name << std::right << " calls " << std::setw(10) << counter.calls
+                << "  cycles/call " << std::setw(10) << counter.GetCyclesPerCall() << "  max " << counter.maxCycles
+                << "\n";
         }
     };
 
-    class CollectionCenterCell : public ForegroundCell
+    inline std::uint64_t ReadCycleCounter()
+    {
+#if defined(PDOGS_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+#ifdef PDOGS_PROFILE
+    // Adds the cycles spent in its scope to counter, if not null.
+    class ProfileTimer
     {
     public:
-        CollectionCenterCell(
-            CellPosition topLeft,
-            IGameManager *gameManager)
-            : ForegroundCell(topLeft),
-              gameManager_{gameManager} {}
+        explicit ProfileTimer(EngineProfile::Counter *counter)
+            : counter_(counter), start_(counter != nullptr ? ReadCycleCounter() : 0) {}
 
-        void Accept(const CellVisitor *visitor) const override
-        {
-            visitor->Visit(this);
-        }
+        ProfileTimer(const ProfileTimer &) = delete;
+        ProfileTimer &operator=(const ProfileTimer &) = delete;
 
-        std::size_t GetWidth() const override
-        {
-            return GameManagerConfig::kGoalSize;
-        }
-        std::size_t GetHeight() const override
-        {
-            return GameManagerConfig::kGoalSize;
-        }
-        std::size_t GetCapacity(CellPosition cellPosition) const override
-        {
-            return GameManagerConfig::kConveyorBufferSize;
-        }
-        void ReceiveProduct(CellPosition cellPosition, int number) override
+        ~ProfileTimer()
         {
-            assert(number != 0);
-
-            if (number)
+            if (counter_ != nullptr)
             {
-                gameManager_->OnProductReceived(number);
+                counter_->Add(ReadCycleCounter() - start_);
             }
         }
-        int GetScores() const
-        {
-            return gameManager_->GetScores();
-        }
 
     private:
-        IGameManager *gameManager_;
+        EngineProfile::Counter *counter_;
+        std::uint64_t start_;
+    };
+#else
+    class ProfileTimer
+    {
+    public:
+        explicit ProfileTimer(EngineProfile::Counter *) {}
     };
+#endif
 
-    class LayeredCell
+    // Hashed timer wheel keyed by tick. Entries due further away than one
+    // revolution simply stay in their slot until their tick comes up.
+    class TimerWheel
     {
     public:
-        std::shared_ptr<ForegroundCell> GetForeground() const
-        {
-            return foreground_;
-        }
-        std::shared_ptr<IBackgroundCell> GetBackground() const
-        {
-            return background_;
-        }
-        bool CanBuild() const
+        static constexpr std::size_t kSlotCount = 128;
+
+        void Schedule(int tile, std::size_t dueTick)
         {
-            return foreground_ == nullptr &&
-                   (background_ == nullptr || background_->CanBuild());
+            slots_[dueTick % kSlotCount].push_back({tile, dueTick});
         }
 
-        void SetForegrund(const std::shared_ptr<ForegroundCell> &value)
+        template <typename TCallback>
+        void PopDue(std::size_t tick, TCallback callback)
         {
-            foreground_ = value;
+            auto &slot = slots_[tick % kSlotCount];
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < slot.size(); ++i)
+            {
+                if (slot[i].dueTick == tick)
+                {
+                    callback(slot[i].tile);
+                }
+                else
+                {
+                    slot[kept++] = slot[i];
+                }
+            }
+            slot.resize(kept);
         }
-        void SetBackground(const std::shared_ptr<IBackgroundCell> &value)
+
+        void Clear()
         {
-            background_ = value;
+            for (auto &slot : slots_)
+            {
+                slot.clear();
+            }
         }
 
     private:
-        std::shared_ptr<ForegroundCell> foreground_;
-        std::shared_ptr<IBackgroundCell> background_;
-    };
+        struct Entry
+        {
+            int tile;
+            std::size_t dueTick;
+        };
 
+        std::array<std::vector<Entry>, kSlotCount> slots_;
+    };
 
-    class GameBoard
+    // Threads over which GameBoard::Update() spreads its partitions in
+    // SchedulingMode::kParallel. The calling thread takes part in every Run().
+    class UpdateWorkerPool
     {
     public:
-        const LayeredCell &GetLayeredCell(CellPosition cellPosition) const
+        explicit UpdateWorkerPool(std::size_t threadCount)
+            : task_{}, taskCount_{}, nextTask_{}, pendingWorkers_{}, generation_{}, stopping_{}
         {
-            return layeredCells_[cellPosition.row][cellPosition.col];
-        }
-
-        bool CanBuild(const std::shared_ptr<ForegroundCell> &cell)
-        {
-            if (cell == nullptr)
+            for (std::size_t i = 1; i < threadCount; ++i)
             {
-                return false;
+                workers_.emplace_back([this]() { WorkerLoop(); });
             }
+        }
 
-            CellPosition cellPosition = cell->GetTopLeftCellPosition();
+        UpdateWorkerPool(const UpdateWorkerPool &) = delete;
+        UpdateWorkerPool &operator=(const UpdateWorkerPool &) = delete;
 
-            if (cellPosition.col < 0 || cellPosition.col + cell->GetWidth() > GameManagerConfig::kBoardWidth ||
-                cellPosition.row < 0 || cellPosition.row + cell->GetHeight() > GameManagerConfig::kBoardHeight)
+        ~UpdateWorkerPool()
+        {
             {
-                return false;
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
             }
-
-            for (std::size_t i = 0; i < cell->GetHeight(); ++i)
+            wake_.notify_all();
+            for (std::thread &worker : workers_)
             {
-                for (std::size_t j = 0; j < cell->GetWidth(); ++j)
-                {
-                    if (!layeredCells_[cellPosition.row + i][cellPosition.col + j].CanBuild())
-                    {
-                        return false;
-                    }
-                }
+                worker.join();
             }
-            return true;
         }
 
-        template <typename TCell, typename... TArgs>
-        bool Build(CellPosition cellPosition, TArgs... args)
+        std::size_t GetThreadCount() const
         {
-            auto cell = std::make_shared<TCell>(cellPosition, args...);
-            if (!CanBuild(cell))
-                return false;
-
-            CellPosition topLeft = cell->GetTopLeftCellPosition();
+            return workers_.size() + 1;
+        }
 
-            for (std::size_t i = 0; i < cell->GetHeight(); ++i)
+        // Calls task(index) once for every index in [0, taskCount) and
+        // returns when all calls have finished.
+        void Run(std::size_t taskCount, const std::function<void(std::size_t)> &task)
+        {
+            if (workers_.empty() || taskCount <= 1)
             {
-                for (std::size_t j = 0; j < cell->GetWidth(); ++j)
+                for (std::size_t i = 0; i < taskCount; ++i)
                 {
-                    layeredCells_[topLeft.row + i][topLeft.col + j].SetForegrund(cell);
+                    task(i);
                 }
+                return;
             }
-            return true;
-        }
-
-        void Remove(CellPosition cellPosition)
-        {
-            auto foreground = layeredCells_[cellPosition.row][cellPosition.col].GetForeground();
 
-            if (foreground != nullptr)
             {
-                if (foreground->CanRemove())
-                {
-                    auto topLeftCellPosition = foreground->GetTopLeftCellPosition();
-
-                    for (std::size_t i = 0; i < foreground->GetHeight(); ++i)
-                    {
-                        for (std::size_t j = 0; j < foreground->GetWidth(); ++j)
-                        {
-                            layeredCells_[topLeftCellPosition.row + i][topLeftCellPosition.col + j].SetForegrund(nullptr);
-                        }
-                    }
-                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                task_ = &task;
+                taskCount_ = taskCount;
+                nextTask_.store(0, std::memory_order_relaxed);
+                pendingWorkers_ = workers_.size();
+                ++generation_;
             }
+            wake_.notify_all();
+            RunTasks();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this]() { return pendingWorkers_ == 0; });
         }
 
-        void SetBackground(CellPosition cellPosition, std::shared_ptr<IBackgroundCell> value)
+    private:
+        void RunTasks()
         {
-            layeredCells_[cellPosition.row][cellPosition.col].SetBackground(value);
+            for (std::size_t i = nextTask_.fetch_add(1); i < taskCount_; i = nextTask_.fetch_add(1))
+            {
+                (*task_)(i);
+            }
         }
 
-        void Update()
+        void WorkerLoop()
         {
-            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row)
+            std::size_t seenGeneration = 0;
+            while (true)
             {
-                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col)
                 {
-                    auto &layeredCell = layeredCells_[row][col];
-                    auto foreground = layeredCell.GetForeground();
-                    if (foreground != nullptr)
-                    {
-                        foreground->UpdatePassOne({row, col}, *this);
-                    }
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wake_.wait(lock, [&]() { return stopping_ || generation_ != seenGeneration; });
+                    if (stopping_)
+                        return;
+                    seenGeneration = generation_;
                 }
-            }
-            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row)
-            {
-                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col)
+
+                RunTasks();
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--pendingWorkers_ == 0)
                 {
-                    auto &layeredCell = layeredCells_[row][col];
-                    auto foreground = layeredCell.GetForeground();
-                    if (foreground != nullptr)
-                    {
-                        foreground->UpdatePassTwo({row, col}, *this);
-                    }
+                    done_.notify_one();
                 }
             }
         }
 
-    private:
-        std::array<std::array<LayeredCell, GameManagerConfig::kBoardWidth>, GameManagerConfig::kBoardHeight> layeredCells_;
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        const std::function<void(std::size_t)> *task_;
+        std::size_t taskCount_;
+        std::atomic<std::size_t> nextTask_;
+        std::size_t pendingWorkers_;
+        std::size_t generation_;
+        bool stopping_;
     };
 
-    bool IsWithinBoard(CellPosition cellPosition)
+    enum class PlayerActionType
     {
-        return cellPosition.row >= 0 && cellPosition.row < GameManagerConfig::kBoardHeight &&
-               cellPosition.col >= 0 && cellPosition.col < GameManagerConfig::kBoardWidth;
-    }
+        None,
+        BuildLeftOutMiningMachine,
+        BuildTopOutMiningMachine,
+        BuildRightOutMiningMachine,
+        BuildBottomOutMiningMachine,
+        BuildLeftToRightConveyor,
+        BuildTopToBottomConveyor,
+        BuildRightToLeftConveyor,
+        BuildBottomToTopConveyor,
+        BuildTopOutCombiner,
+        BuildRightOutCombiner,
+        BuildBottomOutCombiner,
+        BuildLeftOutCombiner,
+        Clear,
+    };
+
+    struct PlayerAction
+    {
+        PlayerActionType type;
+        CellPosition cellPosition;
+    };
 
-    void SendProduct(GameBoard &board, CellPosition cellPosition, Direction direction, int product)
+    // Every class that depends on the board configuration, specialized at
+    // compile time for one TConfig, which provides the members of
+    // GameManagerConfig. Feis::Engine and the aliases below are the
+    // specialization for the course map; others are used through their
+    // nested names, e.g. BasicEngine<LargeConfig>::GameManager. Boards keep
+    // their per-tile arrays inline, so allocate large ones on the heap.
+    template <typename TConfig>
+    class BasicEngine
     {
-        CellPosition targetCellPosition = GetNeighborCellPosition(cellPosition, direction);
+    public:
+        class GameBoard;
+
+        class FlatGameBoard;
 
-        if (!IsWithinBoard(targetCellPosition))
-            return;
+        class LayeredCell;
 
-        auto foregroundCell = board.GetLayeredCell(targetCellPosition).GetForeground();
+        class NumberCellIndex;
 
-        if (foregroundCell)
+        class IGameInfo
         {
-            foregroundCell->ReceiveProduct(targetCellPosition, product);
-        }
-    }
+        public:
+            virtual std::string GetLevelInfo() const = 0;
+            virtual const LayeredCell &GetLayeredCell(CellPosition cellPosition) const = 0;
+            virtual bool IsScoredProduct(int number) const = 0;
+            virtual int GetScores() const = 0;
+            virtual int GetEndTime() const = 0;
+            virtual int GetElapsedTime() const = 0;
+            virtual bool IsGameOver() const = 0;
+            // 64-bit identity of the current board state (e.g. for cycle
+            // detection or as a cache key). GameBoard keeps it up to date, so
+            // it is cheap to read every tick; the flat, variant and chunked
+            // boards hash their GetState() on every call, O(active tiles).
+            virtual std::uint64_t GetStateHash() const = 0;
+            // Conveyors on a shortest route from cellPosition into the
+            // collection center over tiles on which a conveyor can be built
+            // (1 next to it, 0 on it), or -1 if there is none. Kept up to date
+            // by the board as cells are built and removed, so reading it is O(1).
+            virtual int GetDistanceToCollectionCenter(CellPosition cellPosition) const = 0;
+            // Every NumberCell of the board, indexed by number, residue and
+            // position, with its buildable flag kept up to date.
+            virtual const NumberCellIndex &GetNumberCellIndex() const = 0;
+        };
 
-    std::size_t GetNeighborCapacity(const GameBoard &board, CellPosition cellPosition, Direction direction)
-    {
-        CellPosition neighborCellPosition = GetNeighborCellPosition(cellPosition, direction);
+        class IGameManager : public IGameInfo
+        {
+        public:
+            virtual void OnProductReceived(int number) = 0;
+        };
 
-        if (!IsWithinBoard(neighborCellPosition))
-            return 0;
+        class Cell;
 
-        auto foregroundCell = board.GetLayeredCell(neighborCellPosition).GetForeground();
+        class NumberCell;
+        class CollectionCenterCell;
+        class MiningMachineCell;
+        class ConveyorCell;
+        class CombinerCell;
+        class WallCell;
 
-        if (foregroundCell)
+        class CellVisitor
         {
-            return foregroundCell->GetCapacity(neighborCellPosition);
-        }
-        return 0;
-    }
-
-    class NumberCell : public IBackgroundCell
-    {
-    public:
-        NumberCell(int number) : number_(number) {}
+        public:
+            virtual void Visit(const NumberCell *cell) const {}
+            virtual void Visit(const CollectionCenterCell *cell) const  {}
+            virtual void Visit(const MiningMachineCell *cell) const  {}
+            virtual void Visit(const ConveyorCell *cell) const  {}
+            virtual void Visit(const CombinerCell *cell) const  {}
+            virtual void Visit(const WallCell *cell) const  {}
+        };
 
-        int GetNumber() const
+        class Cell
         {
-            return number_;
-        }
+        public:
+            virtual void Accept(const CellVisitor *visitor) const = 0;
+            // Position-independent hash of the cell's type, orientation and
+            // contents. Miner timers are left out; see GameBoard::GetStateHash().
+            virtual std::uint64_t GetStateHash() const { return 0; }
+            virtual ~Cell() {}
+        };
 
-        bool CanBuild() const override
+        class IBackgroundCell : public Cell
         {
-            return true;
-        }
+        public:
+            virtual bool CanBuild() const = 0;
+            virtual ~IBackgroundCell() {}
+        };
 
-        void Accept(const CellVisitor *visitor) const override
+        class ForegroundCell : public Cell
         {
-            visitor->Visit(this);
-        }
+        public:
+            ForegroundCell(CellPosition topLeftCellPosition) : topLeftCellPosition_(topLeftCellPosition) {}
 
-    private:
-        int number_;
-    };
+            virtual std::size_t GetWidth() const { return 1; }
 
-    class BackgroundCellFactory
-    {
-    public:
-        BackgroundCellFactory(unsigned int seed) : gen_(seed) {}
+            virtual std::size_t GetHeight() const { return 1; }
+
+            virtual CellPosition GetTopLeftCellPosition() const { return topLeftCellPosition_; }
+
+            virtual bool CanRemove() const { return false; }
+
+            // Whether UpdatePassOne/UpdatePassTwo can do anything at this tile.
+            // GameBoard only visits updatable tiles.
+            virtual bool IsUpdatable(CellPosition cellPosition) const { return false; }
+
+            virtual std::size_t GetCapacity(CellPosition cellPosition) const { return 0; }
+
+            virtual void ReceiveProduct(CellPosition cellPosition, int number) { }
+
+            virtual void UpdatePassOne(CellPosition cellPosition, GameBoard &board) { }
+
+            virtual void UpdatePassTwo(CellPosition cellPosition, GameBoard &board) { }
+
+            static constexpr std::size_t kIdleUntilWoken = static_cast<std::size_t>(-1);
+
+            // Event-driven scheduling: the number of upcoming ticks in which both
+            // passes would do nothing but advance an internal timer, or
+            // kIdleUntilWoken if only an incoming product can give the cell work.
+            virtual std::size_t GetIdleTicks(CellPosition cellPosition) const { return kIdleUntilWoken; }
+
+            // Catches up on ticks that were skipped while the cell was asleep.
+            virtual void SkipTicks(std::size_t ticks) { }
+
+            // The direction in which pass one at the updatable tile sends
+            // products, or false if it never sends any.
+            virtual bool GetOutputDirection(Direction &direction) const { return false; }
+
+            // Appends the mutable state (products, slots, timers) owned by this tile.
+            virtual void AppendState(CellPosition cellPosition, std::vector<int> &state) const { }
+
+            // Restores what AppendState() appended and returns the first int
+            // after it, or nullptr (leaving the cell as it was) if state is
+            // not one this cell can be in.
+            virtual const int *ReadState(CellPosition cellPosition, const int *state) { return state; }
+
+            // A private copy for a forked game owned by gameManager, or nullptr
+            // if the cell has no mutable state and can be shared between forks.
+            virtual std::shared_ptr<ForegroundCell> Clone(IGameManager *gameManager) const { return nullptr; }
+
+            virtual ~ForegroundCell() {}
+
+        protected:
+            CellPosition topLeftCellPosition_;
+        };
+
+        class ICellRenderer
+        {
+        public:
+            virtual void RenderPassOne(CellPosition position) const = 0;
+            virtual void RenderPassTwo(CellPosition position) const = 0;
+        };
+
+        class ProfiledCellTypeVisitor : public CellVisitor
+        {
+        public:
+            explicit ProfiledCellTypeVisitor(EngineProfile::CellType *type) : type_(type) {}
+
+            void Visit(const ConveyorCell *cell) const override { *type_ = EngineProfile::kConveyor; }
+            void Visit(const CombinerCell *cell) const override { *type_ = EngineProfile::kCombiner; }
+            void Visit(const MiningMachineCell *cell) const override { *type_ = EngineProfile::kMiningMachine; }
+
+        private:
+            EngineProfile::CellType *type_;
+        };
+
+        static bool IsWithinBoard(CellPosition cellPosition)
+        {
+            return cellPosition.row >= 0 && cellPosition.row < TConfig::kBoardHeight &&
+                   cellPosition.col >= 0 && cellPosition.col < TConfig::kBoardWidth;
+        }
+
+        // Reports the new GetStateHash() of a cell that changed during an update.
+        static void OnCellStateChanged(GameBoard &board, CellPosition cellPosition, std::uint64_t hash)
+        {
+            board.OnCellStateChanged(cellPosition, hash);
+        }
+
+        template <typename TGameBoard>
+        static void SendProduct(TGameBoard &board, CellPosition cellPosition, Direction direction, int product)
+        {
+            CellPosition targetCellPosition = GetNeighborCellPosition(cellPosition, direction);
+
+            if (!IsWithinBoard(targetCellPosition))
+                return;
+
+            board.ReceiveProduct(targetCellPosition, product);
+        }
+
+        template <typename TGameBoard>
+        static std::size_t GetNeighborCapacity(const TGameBoard &board, CellPosition cellPosition, Direction direction)
+        {
+            CellPosition neighborCellPosition = GetNeighborCellPosition(cellPosition, direction);
+
+            if (!IsWithinBoard(neighborCellPosition))
+                return 0;
+
+            return board.GetCapacity(neighborCellPosition);
+        }
+
+        // Product slots of a conveyor, front (slot 0) to back. A bitmask of the
+        // occupied slots is kept next to the values, so the spacing rules below
+        // reduce to a few bit operations instead of rescanning the array.
+        class ConveyorBuffer
+        {
+        public:
+            static constexpr std::size_t kSize = TConfig::kConveyorBufferSize;
+
+            static_assert(kSize >= 3 && kSize <= 64, "conveyor buffer must fit in the occupancy mask");
+
+            ConveyorBuffer() : products_{}, occupied_{}, hash_{} {}
+
+            int operator[](std::size_t i) const { return products_[i]; }
+
+            std::size_t size() const { return kSize; }
+
+            bool IsEmpty() const { return occupied_ == 0; }
+
+            // Zobrist hash of the occupied slots, kept up to date by every move.
+            std::uint64_t GetHash() const { return hash_; }
+
+            const int *begin() const { return products_.data(); }
+
+            const int *end() const { return products_.data() + kSize; }
+
+            // Number of free slots at the back of the buffer.
+            std::size_t GetCapacity() const
+            {
+                return occupied_ == 0 ? kSize : kSize - 1 - FindLastSet(occupied_);
+            }
+
+            void Receive(int number)
+            {
+                assert(number != 0);
+                assert(!(occupied_ >> (kSize - 1) & 1));
+                products_[kSize - 1] = number;
+                occupied_ |= std::uint64_t{1} << (kSize - 1);
+                hash_ ^= SlotKey(kSize - 1, number);
+            }
+
+            // Pass one: hands out the front product if the next cell has room for
+            // it (returns 0 otherwise) and closes gaps in the first three slots.
+            int AdvanceFront(std::size_t capacity)
+            {
+                int sent = 0;
+
+                if (capacity >= 3 && (occupied_ & 0b001))
+                {
+                    sent = products_[0];
+                    products_[0] = 0;
+                    occupied_ &= ~std::uint64_t{0b001};
+                    hash_ ^= SlotKey(0, sent);
+                }
+                if (capacity >= 2 && (occupied_ & 0b011) == 0b010)
+                {
+                    Move(1, 0);
+                }
+                if (capacity >= 1 && (occupied_ & 0b111) == 0b100)
+                {
+                    Move(2, 1);
+                }
+                return sent;
+            }
+
+            // Pass two: from front to back, a product moves one slot forward when
+            // the three slots in front of it are empty.
+            void AdvanceBack()
+            {
+                std::uint64_t pending = occupied_ & ~std::uint64_t{0b111};
+                while (pending != 0)
+                {
+                    const int k = CountTrailingZeros(pending);
+                    pending &= pending - 1;
+                    if ((occupied_ >> (k - 3) & 0b111) == 0)
+                    {
+                        Move(k, k - 1);
+                    }
+                }
+            }
+
+            void Assign(const int *products)
+            {
+                occupied_ = 0;
+                hash_ = 0;
+                for (std::size_t i = 0; i < kSize; ++i)
+                {
+                    products_[i] = products[i];
+                    if (products[i] != 0)
+                    {
+                        occupied_ |= std::uint64_t{1} << i;
+                        hash_ ^= SlotKey(i, products[i]);
+                    }
+                }
+            }
+
+            void Clear()
+            {
+                products_.fill(0);
+                occupied_ = 0;
+                hash_ = 0;
+            }
+
+            bool operator==(const ConveyorBuffer &other) const
+            {
+                return products_ == other.products_;
+            }
+
+        private:
+            static std::uint64_t SlotKey(std::size_t slot, int number)
+            {
+                return MixHash(static_cast<std::uint64_t>(static_cast<std::uint32_t>(number)) << 8 | slot);
+            }
+
+            void Move(int from, int to)
+            {
+                hash_ ^= SlotKey(from, products_[from]) ^ SlotKey(to, products_[from]);
+                products_[to] = products_[from];
+                products_[from] = 0;
+                occupied_ ^= (std::uint64_t{1} << from) | (std::uint64_t{1} << to);
+            }
+
+            std::array<int, kSize> products_;
+            std::uint64_t occupied_;
+            std::uint64_t hash_;
+        };
+
+        class ConveyorCell : public ForegroundCell
+        {
+        public:
+            ConveyorCell(CellPosition topLeftCellPosition, Direction direction)
+                : ForegroundCell(topLeftCellPosition),  products_{}, direction_{direction} {}
+
+            int GetProduct(std::size_t i) const { return products_[i]; }
+
+            std::size_t GetProductCount() const { return products_.size(); }
+
+            Direction GetDirection() const { return direction_; }
+
+            void Accept(const CellVisitor *visitor) const override
+            {
+                visitor->Visit(this);
+            }
+
+            bool CanRemove() const override
+            {
+                return true;
+            }
+
+            bool IsUpdatable(CellPosition cellPosition) const override
+            {
+                return true;
+            }
+
+            bool GetOutputDirection(Direction &direction) const override
+            {
+                direction = direction_;
+                return true;
+            }
+
+            std::size_t GetCapacity(CellPosition cellPosition) const override
+            {
+                return products_.GetCapacity();
+            }
+
+            void ReceiveProduct(CellPosition cellPosition, int number) override
+            {
+                products_.Receive(number);
+            }
+
+            void UpdatePassOne(CellPosition cellPosition, GameBoard &board) override
+            {
+                const std::uint64_t hash = products_.GetHash();
+                RunPassOne(cellPosition, board);
+                if (products_.GetHash() != hash)
+                {
+                    OnCellStateChanged(board, cellPosition, ConveyorCell::GetStateHash());
+                }
+            }
+
+            void UpdatePassTwo(CellPosition cellPosition, GameBoard &board) override
+            {
+                const std::uint64_t hash = products_.GetHash();
+                RunPassTwo(cellPosition, board);
+                if (products_.GetHash() != hash)
+                {
+                    OnCellStateChanged(board, cellPosition, ConveyorCell::GetStateHash());
+                }
+            }
+
+            template <typename TGameBoard>
+            void RunPassOne(CellPosition cellPosition, TGameBoard &board)
+            {
+                std::size_t capacity = GetNeighborCapacity(board, cellPosition, direction_);
+
+                if (int product = products_.AdvanceFront(capacity))
+                {
+                    SendProduct(board, cellPosition, direction_, product);
+                }
+            }
+
+            template <typename TGameBoard>
+            void RunPassTwo(CellPosition cellPosition, TGameBoard &board)
+            {
+                products_.AdvanceBack();
+            }
+
+            void AppendState(CellPosition cellPosition, std::vector<int> &state) const override
+            {
+                state.insert(state.end(), products_.begin(), products_.end());
+            }
+
+            const int *ReadState(CellPosition cellPosition, const int *state) override
+            {
+                products_.Assign(state);
+                return state + products_.size();
+            }
+
+            std::size_t GetIdleTicks(CellPosition cellPosition) const override
+            {
+                return products_.IsEmpty() ? ForegroundCell::kIdleUntilWoken : 0;
+            }
+
+            std::uint64_t GetStateHash() const override
+            {
+                return MixHash(0x10 + static_cast<int>(direction_)) ^ products_.GetHash();
+            }
+
+            std::shared_ptr<ForegroundCell> Clone(IGameManager *gameManager) const override
+            {
+                return std::make_shared<ConveyorCell>(*this);
+            }
+
+        protected:
+            ConveyorBuffer products_;
+
+        private:
+            friend class GameBoard;
+            friend class FlatGameBoard;
+
+            Direction direction_;
+        };
+
+        class CombinerCell : public ForegroundCell
+        {
+        public:
+            CombinerCell(CellPosition topLeft, Direction direction)
+                : ForegroundCell(topLeft), direction_{direction}, firstSlotProduct_{}, secondSlotProduct_{} {}
+
+            Direction GetDirection() const { return direction_; }
+
+            int GetFirstSlotProduct() const { return firstSlotProduct_; }
+
+            int GetSecondSlotProduct() const { return secondSlotProduct_; }
+
+            void Accept(const CellVisitor *visitor) const override
+            {
+                visitor->Visit(this);
+            }
+
+            std::size_t GetWidth() const override
+            {
+                return direction_ == Direction::kTop || direction_ == Direction::kBottom ? 2 : 1;
+            }
+
+            std::size_t GetHeight() const override
+            {
+                return direction_ == Direction::kTop || direction_ == Direction::kBottom ? 1 : 2;
+            }
+
+            bool CanRemove() const override
+            {
+                return true;
+            }
+
+            bool IsMainCell(CellPosition cellPosition) const
+            {
+                switch (direction_)
+                {
+                case Direction::kTop:
+                case Direction::kRight:
+                    return cellPosition != ForegroundCell::topLeftCellPosition_;
+                case Direction::kBottom:
+                case Direction::kLeft:
+                    return cellPosition == ForegroundCell::topLeftCellPosition_;
+                }
+                assert(false);
+                return false;
+            }
+
+            bool IsUpdatable(CellPosition cellPosition) const override
+            {
+                return IsMainCell(cellPosition);
+            }
+
+            bool GetOutputDirection(Direction &direction) const override
+            {
+                direction = direction_;
+                return true;
+            }
+
+            std::size_t GetCapacity(CellPosition cellPosition) const override
+            {
+                if (IsMainCell(cellPosition))
+                {
+                    if (firstSlotProduct_ == 0)
+                    {
+                        return TConfig::kConveyorBufferSize;
+                    }
+                    return 0;
+                }
+
+                if (secondSlotProduct_ == 0)
+                {
+                    return TConfig::kConveyorBufferSize;
+                }
+                return 0;
+            }
+
+            void ReceiveProduct(CellPosition cellPosition, int number) override
+            {
+                assert(number != 0);
+
+                if (IsMainCell(cellPosition))
+                {
+                    firstSlotProduct_ = number;
+                }
+                else
+                {
+                    secondSlotProduct_ = number;
+                }
+            }
+
+            void UpdatePassOne(CellPosition cellPosition, GameBoard &board) override
+            {
+                const int firstSlotProduct = firstSlotProduct_;
+                RunPassOne(cellPosition, board);
+                // Pass one only ever empties both slots together.
+                if (firstSlotProduct_ != firstSlotProduct)
+                {
+                    OnCellStateChanged(board, cellPosition, CombinerCell::GetStateHash());
+                }
+            }
+
+            template <typename TGameBoard>
+            void RunPassOne(CellPosition cellPosition, TGameBoard &board)
+            {
+                if (!IsMainCell(cellPosition))
+                    return;
+
+                if (firstSlotProduct_ != 0 && secondSlotProduct_ != 0)
+                {
+                    if (GetNeighborCapacity(board, cellPosition, direction_) >= 3)
+                    {
+                        SendProduct(board, cellPosition, direction_, firstSlotProduct_ + secondSlotProduct_);
+                        firstSlotProduct_ = 0;
+                        secondSlotProduct_ = 0;
+                    }
+                }
+            }
+
+            std::size_t GetIdleTicks(CellPosition cellPosition) const override
+            {
+                return firstSlotProduct_ != 0 && secondSlotProduct_ != 0 ? 0 : ForegroundCell::kIdleUntilWoken;
+            }
+
+            void AppendState(CellPosition cellPosition, std::vector<int> &state) const override
+            {
+                state.push_back(firstSlotProduct_);
+                state.push_back(secondSlotProduct_);
+            }
+
+            const int *ReadState(CellPosition cellPosition, const int *state) override
+            {
+                firstSlotProduct_ = state[0];
+                secondSlotProduct_ = state[1];
+                return state + 2;
+            }
+
+            std::shared_ptr<ForegroundCell> Clone(IGameManager *gameManager) const override
+            {
+                return std::make_shared<CombinerCell>(*this);
+            }
+
+            std::uint64_t GetStateHash() const override
+            {
+                return MixHash(0x20 + static_cast<int>(direction_)) ^
+                       MixHash(static_cast<std::uint64_t>(static_cast<std::uint32_t>(firstSlotProduct_)) << 32 |
+                               static_cast<std::uint32_t>(secondSlotProduct_));
+            }
+        private:
+            friend class FlatGameBoard;
+
+            Direction direction_;
+            int firstSlotProduct_;
+            int secondSlotProduct_;
+        };
+
+        class WallCell : public ForegroundCell
+        {
+        public:
+            WallCell(CellPosition topLeft) : ForegroundCell(topLeft) {}
+
+            bool CanRemove() const override
+            {
+                return false;
+            }
+            void Accept(const CellVisitor *visitor) const override
+            {
+                visitor->Visit(this);
+            }
+            std::uint64_t GetStateHash() const override
+            {
+                return MixHash(0x40);
+            }
+        };
+
+        class CollectionCenterCell : public ForegroundCell
+        {
+        public:
+            CollectionCenterCell(
+                CellPosition topLeft,
+                IGameManager *gameManager)
+                : ForegroundCell(topLeft),
+                  gameManager_{gameManager} {}
+
+            void Accept(const CellVisitor *visitor) const override
+            {
+                visitor->Visit(this);
+            }
+
+            std::size_t GetWidth() const override
+            {
+                return TConfig::kGoalSize;
+            }
+            std::size_t GetHeight() const override
+            {
+                return TConfig::kGoalSize;
+            }
+            std::size_t GetCapacity(CellPosition cellPosition) const override
+            {
+                return TConfig::kConveyorBufferSize;
+            }
+            void ReceiveProduct(CellPosition cellPosition, int number) override
+            {
+                assert(number != 0);
+
+                if (number)
+                {
+                    gameManager_->OnProductReceived(number);
+                }
+            }
+            int GetScores() const
+            {
+                return gameManager_->GetScores();
+            }
+            std::shared_ptr<ForegroundCell> Clone(IGameManager *gameManager) const override
+            {
+                return std::make_shared<CollectionCenterCell>(ForegroundCell::topLeftCellPosition_, gameManager);
+            }
+            std::uint64_t GetStateHash() const override
+            {
+                return MixHash(0x50);
+            }
+
+        private:
+            friend class FlatGameBoard;
+
+            IGameManager *gameManager_;
+        };
+
+        class LayeredCell
+        {
+        public:
+            const std::shared_ptr<ForegroundCell> &GetForeground() const
+            {
+                return foreground_;
+            }
+            const std::shared_ptr<IBackgroundCell> &GetBackground() const
+            {
+                return background_;
+            }
+            bool CanBuild() const
+            {
+                return foreground_ == nullptr &&
+                       (background_ == nullptr || background_->CanBuild());
+            }
+
+            void SetForegrund(const std::shared_ptr<ForegroundCell> &value)
+            {
+                foreground_ = value;
+            }
+            void SetBackground(const std::shared_ptr<IBackgroundCell> &value)
+            {
+                background_ = value;
+            }
+
+        private:
+            std::shared_ptr<ForegroundCell> foreground_;
+            std::shared_ptr<IBackgroundCell> background_;
+        };
+
+        // Used when forking a board: if the foreground whose top-left tile is
+        // cellPosition has mutable state, replaces it by a clone owned by
+        // gameManager on every tile it covers.
+        template <typename TLayeredCellAt>
+        static void CloneForeground(CellPosition cellPosition, IGameManager *gameManager, TLayeredCellAt layeredCellAt)
+        {
+            const std::shared_ptr<ForegroundCell> &foreground = layeredCellAt(cellPosition).GetForeground();
+            if (foreground == nullptr || foreground->GetTopLeftCellPosition() != cellPosition)
+                return;
+
+            const std::shared_ptr<ForegroundCell> clone = foreground->Clone(gameManager);
+            if (clone == nullptr)
+                return;
+
+            for (std::size_t i = 0; i < clone->GetHeight(); ++i)
+            {
+                for (std::size_t j = 0; j < clone->GetWidth(); ++j)
+                {
+                    layeredCellAt(cellPosition + CellPosition{static_cast<int>(i), static_cast<int>(j)}).SetForegrund(clone);
+                }
+            }
+        }
+
+
+        // Distances of a shortest conveyor route into the collection center
+        // over the tiles on which a conveyor can be built, kept exact by the
+        // boards one tile at a time as cells are built and removed. Opening a
+        // tile can only lower distances, which spread outward from it. Closing
+        // one raises only the distances whose every shortest route ran through
+        // it; those tiles are found level by level and recomputed from the
+        // unaffected tiles around them. Both cost about the size of the region
+        // whose distances change, and reading a distance is O(1). Every open
+        // tile has a distance, so the field is dense on every board: five
+        // bytes per tile.
+        class DistanceField
+        {
+        public:
+            static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+            static constexpr int kUnreachable = -1;
+
+            DistanceField() : distances_(kTileCount, kUnreachable), marks_(kTileCount, kUnmarked)
+            {
+            }
+
+            // Conveyors on a shortest route from cellPosition: 1 next to the
+            // collection center, 0 on it, kUnreachable on blocked tiles and
+            // tiles walled off from it.
+            int Get(CellPosition cellPosition) const
+            {
+                return distances_[ToTile(cellPosition)];
+            }
+
+            void Clear()
+            {
+                std::fill(distances_.begin(), distances_.end(), kUnreachable);
+            }
+
+            // A TCell now covers cellPosition of board.
+            template <typename TCell, typename TGameBoard>
+            void OnBuilt(CellPosition cellPosition, const TGameBoard &board)
+            {
+                if constexpr (std::is_same<TCell, CollectionCenterCell>::value)
+                    AddSource(cellPosition, board);
+                else
+                    Close(cellPosition);
+            }
+
+            // The background at cellPosition of board was replaced; couldBuild
+            // tells whether a conveyor could be built there before.
+            template <typename TGameBoard>
+            void OnBackgroundChanged(CellPosition cellPosition, bool couldBuild, const TGameBoard &board)
+            {
+                const bool canBuild = board.GetLayeredCell(cellPosition).CanBuild();
+                if (canBuild && !couldBuild)
+                    Open(cellPosition, board);
+                else if (!canBuild && couldBuild)
+                    Close(cellPosition);
+            }
+
+            // cellPosition of board is now covered by the collection center.
+            template <typename TGameBoard>
+            void AddSource(CellPosition cellPosition, const TGameBoard &board)
+            {
+                const int tile = ToTile(cellPosition);
+                distances_[tile] = 0;
+                queue_.assign(1, tile);
+                Spread(board);
+            }
+
+            // A conveyor can now be built at cellPosition of board.
+            template <typename TGameBoard>
+            void Open(CellPosition cellPosition, const TGameBoard &board)
+            {
+                const int tile = ToTile(cellPosition);
+                distances_[tile] = ClosestNeighborDistance(tile);
+                if (distances_[tile] == kUnreachable)
+                    return;
+
+                ++distances_[tile];
+                queue_.assign(1, tile);
+                Spread(board);
+            }
+
+            // A conveyor can no longer be built at cellPosition.
+            void Close(CellPosition cellPosition)
+            {
+                const int tile = ToTile(cellPosition);
+                if (distances_[tile] <= 0)
+                    return;
+
+                // The queue holds candidates in order of distance, so every
+                // closer affected tile is marked before a candidate is examined.
+                const int distance = distances_[tile];
+                distances_[tile] = kUnreachable;
+                candidates_.clear();
+                affected_.clear();
+                AddCandidates(tile, distance);
+                for (std::size_t head = 0; head < candidates_.size(); ++head)
+                {
+                    const int candidate = candidates_[head];
+                    if (HasUnaffectedParent(candidate))
+                        continue;
+
+                    marks_[candidate] = kAffected;
+                    affected_.push_back(candidate);
+                    AddCandidates(candidate, distances_[candidate]);
+                }
+
+                for (int affected : affected_)
+                {
+                    distances_[affected] = kUnreachable;
+                }
+                seeds_.clear();
+                for (int affected : affected_)
+                {
+                    const int closest = ClosestNeighborDistance(affected);
+                    if (closest != kUnreachable)
+                    {
+                        distances_[affected] = closest + 1;
+                        seeds_.push_back({closest + 1, affected});
+                    }
+                }
+                std::sort(seeds_.begin(), seeds_.end());
+
+                // Breadth-first search through the affected tiles from seeds of
+                // different distances: always continue from the closer of the
+                // next seed and the next queued tile.
+                queue_.clear();
+                std::size_t seed = 0;
+                std::size_t head = 0;
+                while (seed < seeds_.size() || head < queue_.size())
+                {
+                    int current;
+                    if (head == queue_.size() ||
+                        (seed < seeds_.size() && seeds_[seed].first <= distances_[queue_[head]]))
+                    {
+                        current = seeds_[seed].second;
+                        if (distances_[current] < seeds_[seed++].first)
+                            continue;
+                    }
+                    else
+                    {
+                        current = queue_[head++];
+                    }
+
+                    const int next = distances_[current] + 1;
+                    ForEachNeighbor(current, [&](int neighbor) {
+                        if (marks_[neighbor] == kAffected &&
+                            (distances_[neighbor] == kUnreachable || distances_[neighbor] > next))
+                        {
+                            distances_[neighbor] = next;
+                            queue_.push_back(neighbor);
+                        }
+                    });
+                }
+
+                for (int candidate : candidates_)
+                {
+                    marks_[candidate] = kUnmarked;
+                }
+            }
+
+        private:
+            enum Mark : std::uint8_t
+            {
+                kUnmarked,
+                kCandidate,
+                kAffected
+            };
+
+            static int ToTile(CellPosition cellPosition)
+            {
+                return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+            }
+
+            template <typename TFunction>
+            static void ForEachNeighbor(int tile, TFunction function)
+            {
+                const int col = tile % TConfig::kBoardWidth;
+                if (tile >= TConfig::kBoardWidth)
+                    function(tile - TConfig::kBoardWidth);
+                if (col + 1 < TConfig::kBoardWidth)
+                    function(tile + 1);
+                if (tile + TConfig::kBoardWidth < kTileCount)
+                    function(tile + TConfig::kBoardWidth);
+                if (col > 0)
+                    function(tile - 1);
+            }
+
+            // Tiles with a distance are open or covered by the collection center.
+            int ClosestNeighborDistance(int tile) const
+            {
+                int closest = kUnreachable;
+                ForEachNeighbor(tile, [&](int neighbor) {
+                    const int distance = distances_[neighbor];
+                    if (distance != kUnreachable && (closest == kUnreachable || distance < closest))
+                        closest = distance;
+                });
+                return closest;
+            }
+
+            // Lowers the distances around the tiles in queue_, whose own
+            // distances were just lowered, in breadth-first order.
+            template <typename TGameBoard>
+            void Spread(const TGameBoard &board)
+            {
+                for (std::size_t head = 0; head < queue_.size(); ++head)
+                {
+                    const int next = distances_[queue_[head]] + 1;
+                    ForEachNeighbor(queue_[head], [&](int neighbor) {
+                        if (distances_[neighbor] == kUnreachable
+                                ? board.GetLayeredCell({neighbor / TConfig::kBoardWidth, neighbor % TConfig::kBoardWidth}).CanBuild()
+                                : distances_[neighbor] > next)
+                        {
+                            distances_[neighbor] = next;
+                            queue_.push_back(neighbor);
+                        }
+                    });
+                }
+            }
+
+            void AddCandidates(int tile, int distance)
+            {
+                ForEachNeighbor(tile, [&](int neighbor) {
+                    if (distances_[neighbor] == distance + 1 && marks_[neighbor] == kUnmarked)
+                    {
+                        marks_[neighbor] = kCandidate;
+                        candidates_.push_back(neighbor);
+                    }
+                });
+            }
+
+            bool HasUnaffectedParent(int tile) const
+            {
+                bool found = false;
+                ForEachNeighbor(tile, [&](int neighbor) {
+                    found = found || (distances_[neighbor] == distances_[tile] - 1 && marks_[neighbor] != kAffected);
+                });
+                return found;
+            }
+
+            std::vector<int> distances_;
+            // Scratch space of Close(), kept to avoid reallocating.
+            std::vector<std::uint8_t> marks_;
+            std::vector<int> queue_;
+            std::vector<int> candidates_;
+            std::vector<int> affected_;
+            std::vector<std::pair<int, int>> seeds_;
+        };
+
+        class GameBoard
+        {
+        public:
+            static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+
+            GameBoard()
+                : layeredCells_{}, activeCells_{}, arena_{}, schedulingMode_{SchedulingMode::kEveryTick}, tick_{},
+                  passOneCursor_{kTileCount}, updatableCells_{}, wakeTiles_{}, lastVisitTicks_{}, wakeTicks_{}, awakeTiles_{},
+                  stateHash_{}, cellHashes_{}, timerPhases_{}, timerCount_{},
+                  threadCount_{std::max(1u, std::thread::hardware_concurrency())}, workerPool_{}, partitionsDirty_{true},
+                  partitions_{}, partitionContexts_{}, inParallelPass_{false}, pipelinesDirty_{true}, pipelines_{},
+                  pipelineOfTile_{}, distanceField_{}
+#ifdef PDOGS_PROFILE
+                  , profile_{}, profiledTypes_{}
+#endif
+            {
+                wakeTiles_.fill(-1);
+                timerPhases_.fill(kNoTimer);
+                pipelineOfTile_.fill(kNoPipeline);
+            }
+
+            const LayeredCell &GetLayeredCell(CellPosition cellPosition) const
+            {
+                return layeredCells_[cellPosition.row][cellPosition.col];
+            }
+
+            bool CanBuild(const std::shared_ptr<ForegroundCell> &cell)
+            {
+                if (cell == nullptr)
+                {
+                    return false;
+                }
+                return CanBuild(*cell);
+            }
+
+            bool CanBuild(const ForegroundCell &cell) const
+            {
+                CellPosition cellPosition = cell.GetTopLeftCellPosition();
+
+                if (cellPosition.col < 0 || cellPosition.col + cell.GetWidth() > TConfig::kBoardWidth ||
+                    cellPosition.row < 0 || cellPosition.row + cell.GetHeight() > TConfig::kBoardHeight)
+                {
+                    return false;
+                }
+
+                for (std::size_t i = 0; i < cell.GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < cell.GetWidth(); ++j)
+                    {
+                        if (!layeredCells_[cellPosition.row + i][cellPosition.col + j].CanBuild())
+                        {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+            // Cells are allocated from the arena while one is set (nullptr means
+            // the global heap). The arena must outlive every cell it allocated.
+            void SetArena(CellArena *arena)
+            {
+                arena_ = arena;
+            }
+
+            // Removes every cell, including walls and backgrounds. The scheduling
+            // mode is kept.
+            void Clear()
+            {
+                for (auto &row : layeredCells_)
+                {
+                    row.fill(LayeredCell());
+                }
+                activeCells_.clear();
+                tick_ = 0;
+                passOneCursor_ = kTileCount;
+                updatableCells_.fill(nullptr);
+                wakeTiles_.fill(-1);
+                lastVisitTicks_.fill(0);
+                wakeTicks_.fill(0);
+                awakeTiles_.fill(0);
+                timerWheel_.Clear();
+                stateHash_ = 0;
+                cellHashes_.fill(0);
+                timerPhases_.fill(kNoTimer);
+                timerCount_ = 0;
+                partitionsDirty_ = true;
+                pipelinesDirty_ = true;
+                distanceField_.Clear();
+            }
+
+            // Per-pass counters are added to profile while it is set. No-op
+            // unless compiled with PDOGS_PROFILE.
+            void SetProfile([[maybe_unused]] EngineProfile *profile)
+            {
+#ifdef PDOGS_PROFILE
+                profile_ = profile;
+#endif
+            }
+
+            // Makes this board an independent copy of source for a forked game
+            // owned by gameManager. Backgrounds and stateless cells stay shared
+            // with source; the other cells are cloned onto the heap.
+            void ForkFrom(const GameBoard &source, IGameManager *gameManager)
+            {
+                *this = source;
+                arena_ = nullptr;
+                workerPool_ = nullptr;
+                pipelinesDirty_ = true;
+                SetProfile(nullptr);
+
+                for (int tile = 0; tile < kTileCount; ++tile)
+                {
+                    CloneForeground(ToPosition(tile), gameManager, [this](CellPosition position) -> LayeredCell & {
+                        return layeredCells_[position.row][position.col];
+                    });
+                }
+                for (ActiveCell &activeCell : activeCells_)
+                {
+                    activeCell.cell = layeredCells_[activeCell.position.row][activeCell.position.col].GetForeground().get();
+                    updatableCells_[activeCell.tile] = activeCell.cell;
+                }
+            }
+
+            template <typename TCell, typename... TArgs>
+            bool Build(CellPosition cellPosition, TArgs... args)
+            {
+                // Probe on the stack first so failed builds never allocate.
+                TCell probe(cellPosition, args...);
+                if (!CanBuild(probe))
+                    return false;
+
+                auto cell = MakeCell<TCell>(arena_, probe);
+
+                CellPosition topLeft = cell->GetTopLeftCellPosition();
+                int wakeTile = -1;
+
+                if constexpr (std::is_same<TCell, MiningMachineCell>::value)
+                {
+                    cell->ResolveMinedNumber(layeredCells_[topLeft.row][topLeft.col]);
+
+                    const int tile = ToTile(topLeft);
+                    timerPhases_[tile] = static_cast<std::uint16_t>(tick_ % TConfig::kMiningInterval);
+                    stateHash_ ^= ZobristKey(tile, kTimerLayer, timerPhases_[tile]);
+                    ++timerCount_;
+                }
+
+                for (std::size_t i = 0; i < cell->GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < cell->GetWidth(); ++j)
+                    {
+                        CellPosition position{topLeft.row + static_cast<int>(i), topLeft.col + static_cast<int>(j)};
+                        layeredCells_[position.row][position.col].SetForegrund(cell);
+                        distanceField_.template OnBuilt<TCell>(position, *this);
+                        if (cell->IsUpdatable(position))
+                        {
+                            Activate(position, cell.get());
+                            wakeTile = ToTile(position);
+                        }
+                    }
+                }
+
+                for (std::size_t i = 0; i < cell->GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < cell->GetWidth(); ++j)
+                    {
+                        wakeTiles_[ToTile(topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)})] = wakeTile;
+                    }
+                }
+
+                const int homeTile = wakeTile >= 0 ? wakeTile : ToTile(topLeft);
+                cellHashes_[homeTile] = cell->GetStateHash();
+                stateHash_ ^= ZobristKey(homeTile, kForegroundLayer, cellHashes_[homeTile]);
+                return true;
+            }
+
+            void Remove(CellPosition cellPosition)
+            {
+                auto foreground = layeredCells_[cellPosition.row][cellPosition.col].GetForeground();
+
+                if (foreground != nullptr)
+                {
+                    if (foreground->CanRemove())
+                    {
+                        auto topLeftCellPosition = foreground->GetTopLeftCellPosition();
+
+                        const int topLeftTile = ToTile(topLeftCellPosition);
+                        const int homeTile = wakeTiles_[topLeftTile] >= 0 ? wakeTiles_[topLeftTile] : topLeftTile;
+                        stateHash_ ^= ZobristKey(homeTile, kForegroundLayer, cellHashes_[homeTile]);
+                        cellHashes_[homeTile] = 0;
+                        if (timerPhases_[topLeftTile] != kNoTimer)
+                        {
+                            stateHash_ ^= ZobristKey(topLeftTile, kTimerLayer, timerPhases_[topLeftTile]);
+                            timerPhases_[topLeftTile] = kNoTimer;
+                            --timerCount_;
+                        }
+
+                        for (std::size_t i = 0; i < foreground->GetHeight(); ++i)
+                        {
+                            for (std::size_t j = 0; j < foreground->GetWidth(); ++j)
+                            {
+                                CellPosition position{topLeftCellPosition.row + static_cast<int>(i), topLeftCellPosition.col + static_cast<int>(j)};
+                                Deactivate(position);
+                                wakeTiles_[ToTile(position)] = -1;
+                                layeredCells_[position.row][position.col].SetForegrund(nullptr);
+                                distanceField_.Open(position, *this);
+                            }
+                        }
+                    }
+                }
+            }
+
+            void SetBackground(CellPosition cellPosition, std::shared_ptr<IBackgroundCell> value)
+            {
+                LayeredCell &layeredCell = layeredCells_[cellPosition.row][cellPosition.col];
+                const int tile = ToTile(cellPosition);
+                if (layeredCell.GetBackground() != nullptr)
+                {
+                    stateHash_ ^= ZobristKey(tile, kBackgroundLayer, layeredCell.GetBackground()->GetStateHash());
+                }
+                if (value != nullptr)
+                {
+                    stateHash_ ^= ZobristKey(tile, kBackgroundLayer, value->GetStateHash());
+                }
+                const bool couldBuild = layeredCell.CanBuild();
+                layeredCell.SetBackground(value);
+                distanceField_.OnBackgroundChanged(cellPosition, couldBuild, *this);
+            }
+
+            // See DistanceField::Get().
+            int GetDistanceToCollectionCenter(CellPosition cellPosition) const
+            {
+                return distanceField_.Get(cellPosition);
+            }
+
+            // Zobrist hash of every cell, background and conveyor slot, updated
+            // as cells are built, removed and updated, so reading it is O(1).
+            // Miner timers enter through the tick at which each miner was built
+            // and the current tick, both modulo the mining interval; equal states
+            // reached within the same game therefore hash equally.
+            std::uint64_t GetStateHash() const
+            {
+                if (timerCount_ == 0)
+                    return stateHash_;
+                return stateHash_ ^ ZobristKey(0, kTickLayer, tick_ % TConfig::kMiningInterval);
+            }
+
+            SchedulingMode GetSchedulingMode() const
+            {
+                return schedulingMode_;
+            }
+
+            // Threads used by SchedulingMode::kParallel, the calling one included.
+            // Defaults to the hardware concurrency.
+            void SetThreadCount(std::size_t threadCount)
+            {
+                threadCount_ = std::max<std::size_t>(threadCount, 1);
+                workerPool_ = nullptr;
+                partitionsDirty_ = true;
+            }
+
+            // In kEventDriven mode idle cells are put to sleep after each tick and
+            // are only visited again once their timer fires on the timer wheel or
+            // a neighbor sends them a product. Switching back wakes every cell.
+            // In kParallel mode every cell is visited every tick, but cells that
+            // cannot reach each other through their outputs are updated on
+            // different threads; see UpdateParallel().
+            // In kPipelined mode every chain of conveyors is updated as a single
+            // pipeline; see UpdatePipelined().
+            void SetSchedulingMode(SchedulingMode mode)
+            {
+                if (mode == schedulingMode_)
+                    return;
+
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    Wake(activeCell.position);
+                }
+                timerWheel_.Clear();
+                schedulingMode_ = mode;
+                pipelinesDirty_ = true;
+            }
+
+            std::size_t GetCapacity(CellPosition cellPosition) const
+            {
+                const auto &foreground = layeredCells_[cellPosition.row][cellPosition.col].GetForeground();
+                return foreground ? foreground->GetCapacity(cellPosition) : 0;
+            }
+
+            void ReceiveProduct(CellPosition cellPosition, int number)
+            {
+                const auto &foreground = layeredCells_[cellPosition.row][cellPosition.col].GetForeground();
+                if (foreground && inParallelPass_)
+                {
+                    ReceiveProductInPartition(cellPosition, number, *foreground);
+                }
+                else if (foreground)
+                {
+#ifdef PDOGS_PROFILE
+                    if (profile_ != nullptr)
+                    {
+                        ++profile_->productsMoved;
+                    }
+#endif
+                    foreground->ReceiveProduct(cellPosition, number);
+                    Wake(cellPosition);
+
+                    const int homeTile = wakeTiles_[ToTile(cellPosition)];
+                    if (homeTile >= 0)
+                    {
+                        OnCellStateChanged(ToPosition(homeTile), foreground->GetStateHash());
+                    }
+                    if (schedulingMode_ == SchedulingMode::kPipelined && !pipelinesDirty_ &&
+                        pipelineOfTile_[ToTile(cellPosition)] != kNoPipeline)
+                    {
+                        ++pipelines_[pipelineOfTile_[ToTile(cellPosition)]].productCount;
+                    }
+                }
+            }
+
+            // Replaces the hash of the updatable cell at cellPosition.
+            void OnCellStateChanged(CellPosition cellPosition, std::uint64_t hash)
+            {
+                const int tile = ToTile(cellPosition);
+                const std::uint64_t change =
+                    ZobristKey(tile, kForegroundLayer, cellHashes_[tile]) ^ ZobristKey(tile, kForegroundLayer, hash);
+                cellHashes_[tile] = hash;
+                if (inParallelPass_)
+                {
+                    CurrentPartition()->hashChange ^= change;
+                }
+                else
+                {
+                    stateHash_ ^= change;
+                }
+            }
+
+            // Called whenever a product is delivered to the cell at cellPosition.
+            void Wake(CellPosition cellPosition)
+            {
+                if (schedulingMode_ != SchedulingMode::kEventDriven)
+                    return;
+
+                const int tile = wakeTiles_[ToTile(cellPosition)];
+                if (tile < 0 || IsAwake(tile))
+                    return;
+
+                // A cell woken behind the pass-one cursor also missed this tick's pass one.
+                std::size_t skippedTicks = tick_ - lastVisitTicks_[tile] - 1;
+                if (tile < passOneCursor_)
+                {
+                    ++skippedTicks;
+                }
+                if (skippedTicks > 0)
+                {
+                    updatableCells_[tile]->SkipTicks(skippedTicks);
+                }
+                awakeTiles_[tile / 64] |= std::uint64_t{1} << (tile % 64);
+            }
+
+            // Brings the timers of sleeping cells up to the current tick.
+            void CatchUp()
+            {
+                if (schedulingMode_ != SchedulingMode::kEventDriven)
+                    return;
+
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    if (!IsAwake(activeCell.tile) && lastVisitTicks_[activeCell.tile] < tick_)
+                    {
+                        activeCell.cell->SkipTicks(tick_ - lastVisitTicks_[activeCell.tile]);
+                        lastVisitTicks_[activeCell.tile] = tick_;
+                    }
+                }
+            }
+
+            // Serializes the mutable state of every updatable tile. Two boards
+            // built the same way are in the same state iff these vectors match.
+            void GetState(std::vector<int> &state)
+            {
+                CatchUp();
+                state.clear();
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    state.push_back(activeCell.tile);
+                    activeCell.cell->AppendState(activeCell.position, state);
+                }
+            }
+
+            // Restores a GetState() of a board on which the same cells were built.
+            // Returns false if state does not fit the cells of this board; the
+            // cells before the mismatch are restored all the same.
+            bool SetState(const std::vector<int> &state)
+            {
+                CatchUp();
+                pipelinesDirty_ = true;
+                std::vector<int> expected;
+                const int *it = state.data();
+                const int *end = it + state.size();
+                while (it != end)
+                {
+                    const int tile = *it++;
+                    if (tile < 0 || tile >= kTileCount || updatableCells_[tile] == nullptr)
+                        return false;
+
+                    ForegroundCell *cell = updatableCells_[tile];
+                    expected.clear();
+                    cell->AppendState(ToPosition(tile), expected);
+                    if (end - it < static_cast<std::ptrdiff_t>(expected.size()))
+                        return false;
+
+                    it = cell->ReadState(ToPosition(tile), it);
+                    if (it == nullptr)
+                        return false;
+
+                    OnCellStateChanged(ToPosition(tile), cell->GetStateHash());
+                    awakeTiles_[tile / 64] |= std::uint64_t{1} << (tile % 64);
+                }
+                return true;
+            }
+
+            // What GetStateHash() depends on besides the cells and GetState():
+            // the tick, then the tile and timer phase of every mining machine.
+            void GetClock(std::vector<int> &clock) const
+            {
+                clock.assign(1, static_cast<int>(tick_));
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    if (timerPhases_[activeCell.tile] != kNoTimer)
+                    {
+                        clock.insert(clock.end(), {activeCell.tile, static_cast<int>(timerPhases_[activeCell.tile])});
+                    }
+                }
+            }
+
+            // Restores a GetClock() of a board on which the same cells were
+            // built; false, and no change, if clock does not fit them. Every
+            // cell is woken, as sleeping ones were scheduled by the old tick.
+            bool SetClock(const std::vector<int> &clock)
+            {
+                if (clock.empty() || clock[0] < 0 || clock.size() % 2 == 0 || (clock.size() - 1) / 2 != timerCount_)
+                    return false;
+                for (std::size_t i = 1; i < clock.size(); i += 2)
+                {
+                    const int tile = clock[i];
+                    if (tile < 0 || tile >= kTileCount || timerPhases_[tile] == kNoTimer || (i > 1 && tile <= clock[i - 2]) ||
+                        clock[i + 1] < 0 || clock[i + 1] >= static_cast<int>(TConfig::kMiningInterval))
+                        return false;
+                }
+
+                CatchUp();
+                for (std::size_t i = 1; i < clock.size(); i += 2)
+                {
+                    const int tile = clock[i];
+                    stateHash_ ^= ZobristKey(tile, kTimerLayer, timerPhases_[tile]);
+                    timerPhases_[tile] = static_cast<std::uint16_t>(clock[i + 1]);
+                    stateHash_ ^= ZobristKey(tile, kTimerLayer, timerPhases_[tile]);
+                }
+                tick_ = static_cast<std::size_t>(clock[0]);
+                timerWheel_.Clear();
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    lastVisitTicks_[activeCell.tile] = tick_;
+                    awakeTiles_[activeCell.tile / 64] |= std::uint64_t{1} << (activeCell.tile % 64);
+                }
+                return true;
+            }
+
+            // Visits the updatable tiles in row-major order, exactly like a full
+            // scan of the board would, but without touching empty tiles.
+            void Update()
+            {
+                ++tick_;
+
+                if (schedulingMode_ == SchedulingMode::kEventDriven)
+                {
+                    UpdateEventDriven();
+                    return;
+                }
+                if (schedulingMode_ == SchedulingMode::kParallel)
+                {
+                    UpdateParallel();
+                    return;
+                }
+                if (schedulingMode_ == SchedulingMode::kPipelined)
+                {
+                    UpdatePipelined();
+                    return;
+                }
+
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    ProfileTimer timer(GetPassCounter(activeCell.tile, EngineProfile::kPassOne));
+                    activeCell.cell->UpdatePassOne(activeCell.position, *this);
+                }
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    ProfileTimer timer(GetPassCounter(activeCell.tile, EngineProfile::kPassTwo));
+                    activeCell.cell->UpdatePassTwo(activeCell.position, *this);
+                }
+            }
+
+        private:
+            // What a partition changed outside its own cells during a parallel
+            // pass, folded into the board once every partition is done.
+            struct PartitionResult
+            {
+                struct SinkReceipt
+                {
+                    int sourceTile;
+                    int tile;
+                    int number;
+                };
+
+                int sourceTile;
+                std::uint64_t hashChange;
+                std::size_t productsMoved;
+                std::vector<SinkReceipt> sinkReceipts;
+            };
+
+            // A cell only ever touches itself and the cell its output points at,
+            // so cells connected through outputs form independent components.
+            // Each partition is a set of whole components whose cells are
+            // visited in row-major order, exactly as a serial pass would. The
+            // collection center (any non-updatable receiver) is shared by many
+            // components, but its capacity is constant; products sent to it are
+            // recorded and delivered after the pass in serial order.
+            void UpdateParallel()
+            {
+                if (partitionsDirty_)
+                {
+                    BuildPartitions();
+                }
+                if (workerPool_ == nullptr)
+                {
+                    workerPool_ = std::make_shared<UpdateWorkerPool>(threadCount_);
+                }
+
+                RunPartitions([this](const ActiveCell &activeCell) {
+                    activeCell.cell->UpdatePassOne(activeCell.position, *this);
+                });
+                RunPartitions([this](const ActiveCell &activeCell) {
+                    activeCell.cell->UpdatePassTwo(activeCell.position, *this);
+                });
+            }
+
+            template <typename TPass>
+            void RunPartitions(TPass pass)
+            {
+                inParallelPass_ = true;
+                workerPool_->Run(partitions_.size(), [this, &pass](std::size_t index) {
+                    PartitionResult &result = partitionContexts_[index];
+                    CurrentPartition() = &result;
+                    for (int activeIndex : partitions_[index])
+                    {
+                        result.sourceTile = activeCells_[activeIndex].tile;
+                        pass(activeCells_[activeIndex]);
+                    }
+                    CurrentPartition() = nullptr;
+                });
+                inParallelPass_ = false;
+
+                using SinkReceipt = typename PartitionResult::SinkReceipt;
+                std::vector<SinkReceipt> sinkReceipts;
+                for (PartitionResult &result : partitionContexts_)
+                {
+                    stateHash_ ^= result.hashChange;
+                    result.hashChange = 0;
+#ifdef PDOGS_PROFILE
+                    if (profile_ != nullptr)
+                    {
+                        profile_->productsMoved += result.productsMoved;
+                    }
+#endif
+                    result.productsMoved = 0;
+                    sinkReceipts.insert(sinkReceipts.end(), result.sinkReceipts.begin(), result.sinkReceipts.end());
+                    result.sinkReceipts.clear();
+                }
+
+                std::stable_sort(sinkReceipts.begin(), sinkReceipts.end(),
+                                 [](const SinkReceipt &lhs, const SinkReceipt &rhs) {
+                                     return lhs.sourceTile < rhs.sourceTile;
+                                 });
+                for (const SinkReceipt &receipt : sinkReceipts)
+                {
+                    ReceiveProduct(ToPosition(receipt.tile), receipt.number);
+                }
+            }
+
+            void ReceiveProductInPartition(CellPosition cellPosition, int number, ForegroundCell &foreground)
+            {
+                PartitionResult &result = *CurrentPartition();
+                const int homeTile = wakeTiles_[ToTile(cellPosition)];
+                if (homeTile < 0)
+                {
+                    result.sinkReceipts.push_back({result.sourceTile, ToTile(cellPosition), number});
+                    return;
+                }
+
+                ++result.productsMoved;
+                foreground.ReceiveProduct(cellPosition, number);
+                OnCellStateChanged(ToPosition(homeTile), foreground.GetStateHash());
+            }
+
+            static PartitionResult *&CurrentPartition()
+            {
+                thread_local PartitionResult *partition = nullptr;
+                return partition;
+            }
+
+            void BuildPartitions()
+            {
+                std::vector<int> parents(kTileCount);
+                for (int tile = 0; tile < kTileCount; ++tile)
+                {
+                    parents[tile] = tile;
+                }
+                auto find = [&parents](int tile) {
+                    while (parents[tile] != tile)
+                    {
+                        parents[tile] = parents[parents[tile]];
+                        tile = parents[tile];
+                    }
+                    return tile;
+                };
+
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    Direction direction;
+                    if (!activeCell.cell->GetOutputDirection(direction))
+                        continue;
+                    const CellPosition target = GetNeighborCellPosition(activeCell.position, direction);
+                    if (!IsWithinBoard(target) || wakeTiles_[ToTile(target)] < 0)
+                        continue;
+                    parents[find(activeCell.tile)] = find(wakeTiles_[ToTile(target)]);
+                }
+
+                std::vector<std::vector<int>> components;
+                std::vector<int> componentOfRoot(kTileCount, -1);
+                for (std::size_t i = 0; i < activeCells_.size(); ++i)
+                {
+                    const int root = find(activeCells_[i].tile);
+                    if (componentOfRoot[root] < 0)
+                    {
+                        componentOfRoot[root] = static_cast<int>(components.size());
+                        components.emplace_back();
+                    }
+                    components[componentOfRoot[root]].push_back(static_cast<int>(i));
+                }
+
+                // Largest components first, each onto the least loaded partition.
+                std::sort(components.begin(), components.end(),
+                          [](const std::vector<int> &lhs, const std::vector<int> &rhs) { return lhs.size() > rhs.size(); });
+                partitions_.assign(std::min(components.size(), threadCount_ * 4), {});
+                for (const std::vector<int> &component : components)
+                {
+                    auto lightest = std::min_element(partitions_.begin(), partitions_.end(),
+                                                     [](const std::vector<int> &lhs, const std::vector<int> &rhs) {
+                                                         return lhs.size() < rhs.size();
+                                                     });
+                    lightest->insert(lightest->end(), component.begin(), component.end());
+                }
+                for (std::vector<int> &partition : partitions_)
+                {
+                    std::sort(partition.begin(), partition.end());
+                }
+
+                partitionContexts_.assign(partitions_.size(), PartitionResult{});
+                partitionsDirty_ = false;
+            }
+
+            // A maximal chain of conveyors in which each one outputs into the
+            // next and the next has no other feeder, head first.
+            struct Pipeline
+            {
+                struct Stage
+                {
+                    int tile;
+                    CellPosition position;
+                    ConveyorCell *conveyor;
+                };
+
+                std::vector<Stage> stages;
+                // Products on the whole chain; an empty pipeline is skipped.
+                std::size_t productCount;
+            };
+
+            static constexpr int kNoPipeline = -1;
+
+            // Visits the tiles like the every-tick scan, except that the stages
+            // of a pipeline are all updated when the scan reaches its tail.
+            //
+            // This is exact because, with buffers of at least six slots, pass one
+            // of a conveyor only reads the first three slots of its own buffer
+            // and whether its target has 1, 2 or 3 free slots; a conveyor's own
+            // pass one never changes that answer for its feeders, and a product
+            // received into its last slot never changes its pass one. So only the
+            // tail, whose target lies outside the chain and may also be fed by
+            // others, has to run at its own place in row-major order.
+            void UpdatePipelined()
+            {
+                if (pipelinesDirty_)
+                {
+                    BuildPipelines();
+                }
+
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    const int pipeline = pipelineOfTile_[activeCell.tile];
+                    if (pipeline != kNoPipeline && pipelines_[pipeline].stages.back().tile != activeCell.tile)
+                        continue;
+
+                    ProfileTimer timer(GetPassCounter(activeCell.tile, EngineProfile::kPassOne));
+                    if (pipeline == kNoPipeline)
+                    {
+                        activeCell.cell->UpdatePassOne(activeCell.position, *this);
+                    }
+                    else
+                    {
+                        RunPipelinePassOne(pipelines_[pipeline]);
+                    }
+                }
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    const int pipeline = pipelineOfTile_[activeCell.tile];
+                    if (pipeline != kNoPipeline && pipelines_[pipeline].stages.back().tile != activeCell.tile)
+                        continue;
+
+                    ProfileTimer timer(GetPassCounter(activeCell.tile, EngineProfile::kPassTwo));
+                    if (pipeline == kNoPipeline)
+                    {
+                        activeCell.cell->UpdatePassTwo(activeCell.position, *this);
+                    }
+                    else
+                    {
+                        RunPipelinePassTwo(pipelines_[pipeline]);
+                    }
+                }
+            }
+
+            // Tail first, so a product handed to the next stage is not looked at
+            // again in the same pass.
+            void RunPipelinePassOne(Pipeline &pipeline)
+            {
+                if (pipeline.productCount == 0)
+                    return;
+
+                for (std::size_t i = pipeline.stages.size(); i-- > 0;)
+                {
+                    const typename Pipeline::Stage &stage = pipeline.stages[i];
+                    ConveyorBuffer &products = stage.conveyor->products_;
+                    if (products.IsEmpty())
+                        continue;
+
+                    const std::uint64_t hash = products.GetHash();
+                    if (i + 1 < pipeline.stages.size())
+                    {
+                        const typename Pipeline::Stage &next = pipeline.stages[i + 1];
+                        if (int product = products.AdvanceFront(next.conveyor->products_.GetCapacity()))
+                        {
+                            next.conveyor->products_.Receive(product);
+                            OnCellStateChanged(next.position, next.conveyor->ConveyorCell::GetStateHash());
+#ifdef PDOGS_PROFILE
+                            if (profile_ != nullptr)
+                            {
+                                ++profile_->productsMoved;
+                            }
+#endif
+                        }
+                    }
+                    else
+                    {
+                        const Direction direction = stage.conveyor->direction_;
+                        if (int product = products.AdvanceFront(GetNeighborCapacity(*this, stage.position, direction)))
+                        {
+                            --pipeline.productCount;
+                            SendProduct(*this, stage.position, direction, product);
+                        }
+                    }
+                    if (products.GetHash() != hash)
+                    {
+                        OnCellStateChanged(stage.position, stage.conveyor->ConveyorCell::GetStateHash());
+                    }
+                }
+            }
+
+            void RunPipelinePassTwo(Pipeline &pipeline)
+            {
+                if (pipeline.productCount == 0)
+                    return;
+
+                for (const typename Pipeline::Stage &stage : pipeline.stages)
+                {
+                    if (!stage.conveyor->products_.IsEmpty())
+                    {
+                        stage.conveyor->ConveyorCell::UpdatePassTwo(stage.position, *this);
+                    }
+                }
+            }
+
+            void BuildPipelines()
+            {
+                static_assert(ConveyorBuffer::kSize >= 6, "pipelines rely on pass one never changing a feeder's view");
+
+                std::vector<int> feederCounts(kTileCount);
+                std::vector<ConveyorCell *> conveyors(kTileCount);
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    conveyors[activeCell.tile] = dynamic_cast<ConveyorCell *>(activeCell.cell);
+
+                    Direction direction;
+                    if (!activeCell.cell->GetOutputDirection(direction))
+                        continue;
+                    const CellPosition target = GetNeighborCellPosition(activeCell.position, direction);
+                    if (IsWithinBoard(target) && wakeTiles_[ToTile(target)] >= 0)
+                    {
+                        ++feederCounts[wakeTiles_[ToTile(target)]];
+                    }
+                }
+
+                // Each tile has at most one predecessor, so walking from the tiles
+                // without one never loops; cycles of conveyors stay unpipelined.
+                std::vector<int> successors(kTileCount, -1);
+                std::vector<bool> hasPredecessor(kTileCount);
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    ConveyorCell *conveyor = conveyors[activeCell.tile];
+                    if (conveyor == nullptr)
+                        continue;
+                    const CellPosition target = GetNeighborCellPosition(activeCell.position, conveyor->direction_);
+                    if (!IsWithinBoard(target))
+                        continue;
+                    const int targetTile = ToTile(target);
+                    if (conveyors[targetTile] != nullptr && feederCounts[targetTile] == 1)
+                    {
+                        successors[activeCell.tile] = targetTile;
+                        hasPredecessor[targetTile] = true;
+                    }
+                }
+
+                pipelines_.clear();
+                pipelineOfTile_.fill(kNoPipeline);
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    if (hasPredecessor[activeCell.tile] || successors[activeCell.tile] < 0)
+                        continue;
+
+                    Pipeline pipeline{{}, 0};
+                    for (int tile = activeCell.tile; tile >= 0; tile = successors[tile])
+                    {
+                        pipeline.stages.push_back({tile, ToPosition(tile), conveyors[tile]});
+                        pipelineOfTile_[tile] = static_cast<int>(pipelines_.size());
+                        for (int product : conveyors[tile]->products_)
+                        {
+                            pipeline.productCount += product != 0;
+                        }
+                    }
+                    pipelines_.push_back(std::move(pipeline));
+                }
+                pipelinesDirty_ = false;
+            }
+
+            void UpdateEventDriven()
+            {
+                passOneCursor_ = -1;
+                timerWheel_.PopDue(tick_, [this](int tile) {
+                    if (updatableCells_[tile] != nullptr && wakeTicks_[tile] == tick_)
+                    {
+                        Wake(ToPosition(tile));
+                    }
+                });
+
+                // Cells woken during a pass are picked up by the same pass when
+                // they lie ahead of the cursor, as in a full row-major scan.
+                for (int tile = NextAwakeTile(0); tile >= 0; tile = NextAwakeTile(tile + 1))
+                {
+                    passOneCursor_ = tile;
+                    ProfileTimer timer(GetPassCounter(tile, EngineProfile::kPassOne));
+                    updatableCells_[tile]->UpdatePassOne(ToPosition(tile), *this);
+                }
+                passOneCursor_ = kTileCount;
+
+                for (int tile = NextAwakeTile(0); tile >= 0; tile = NextAwakeTile(tile + 1))
+                {
+                    ProfileTimer timer(GetPassCounter(tile, EngineProfile::kPassTwo));
+                    updatableCells_[tile]->UpdatePassTwo(ToPosition(tile), *this);
+                }
+
+                for (int tile = NextAwakeTile(0); tile >= 0; tile = NextAwakeTile(tile + 1))
+                {
+                    std::size_t idleTicks = updatableCells_[tile]->GetIdleTicks(ToPosition(tile));
+                    if (idleTicks == 0)
+                        continue;
+
+                    awakeTiles_[tile / 64] &= ~(std::uint64_t{1} << (tile % 64));
+                    lastVisitTicks_[tile] = tick_;
+                    if (idleTicks != ForegroundCell::kIdleUntilWoken)
+                    {
+                        wakeTicks_[tile] = tick_ + idleTicks + 1;
+                        timerWheel_.Schedule(tile, wakeTicks_[tile]);
+                    }
+                }
+            }
+
+            enum HashLayer : std::uint64_t
+            {
+                kForegroundLayer,
+                kBackgroundLayer,
+                kTimerLayer,
+                kTickLayer
+            };
+
+            static constexpr std::uint16_t kNoTimer = 0xFFFF;
+            static_assert(TConfig::kMiningInterval <= kNoTimer, "mining phases must fit below kNoTimer");
+
+            static std::uint64_t ZobristKey(int tile, HashLayer layer, std::uint64_t value)
+            {
+                return MixHash(value ^ (static_cast<std::uint64_t>(tile) << 2 | layer) * 0xD6E8FEB86659FD93ull);
+            }
+
+            EngineProfile::Counter *GetPassCounter([[maybe_unused]] int tile, [[maybe_unused]] EngineProfile::Pass pass)
+            {
+#ifdef PDOGS_PROFILE
+                return profile_ != nullptr ? &profile_->cellPasses[profiledTypes_[tile]][pass] : nullptr;
+#else
+                return nullptr;
+#endif
+            }
+
+            bool IsAwake(int tile) const
+            {
+                return (awakeTiles_[tile / 64] >> (tile % 64)) & 1;
+            }
+
+            int NextAwakeTile(int from) const
+            {
+                std::size_t word = from / 64;
+                if (word >= awakeTiles_.size())
+                    return -1;
+
+                std::uint64_t bits = awakeTiles_[word] & (~std::uint64_t{0} << (from % 64));
+                while (bits == 0)
+                {
+                    if (++word == awakeTiles_.size())
+                        return -1;
+                    bits = awakeTiles_[word];
+                }
+                return static_cast<int>(word * 64 + CountTrailingZeros(bits));
+            }
+
+            static CellPosition ToPosition(int tile)
+            {
+                return {tile / TConfig::kBoardWidth, tile % TConfig::kBoardWidth};
+            }
+
+            struct ActiveCell
+            {
+                int tile;
+                CellPosition position;
+                ForegroundCell *cell;
+            };
+
+            static int ToTile(CellPosition cellPosition)
+            {
+                return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+            }
+
+            typename std::vector<ActiveCell>::iterator FindActiveCell(int tile)
+            {
+                return std::lower_bound(
+                    activeCells_.begin(), activeCells_.end(), tile,
+                    [](const ActiveCell &activeCell, int value) { return activeCell.tile < value; });
+            }
+
+            void Activate(CellPosition cellPosition, ForegroundCell *cell)
+            {
+                const int tile = ToTile(cellPosition);
+                activeCells_.insert(FindActiveCell(tile), ActiveCell{tile, cellPosition, cell});
+                updatableCells_[tile] = cell;
+#ifdef PDOGS_PROFILE
+                profiledTypes_[tile] = EngineProfile::kOtherCell;
+                ProfiledCellTypeVisitor visitor(&profiledTypes_[tile]);
+                cell->Accept(&visitor);
+#endif
+                awakeTiles_[tile / 64] |= std::uint64_t{1} << (tile % 64);
+                partitionsDirty_ = true;
+                pipelinesDirty_ = true;
+            }
+
+            void Deactivate(CellPosition cellPosition)
+            {
+                const int tile = ToTile(cellPosition);
+                partitionsDirty_ = true;
+                pipelinesDirty_ = true;
+                updatableCells_[tile] = nullptr;
+                awakeTiles_[tile / 64] &= ~(std::uint64_t{1} << (tile % 64));
+                auto it = FindActiveCell(tile);
+                if (it != activeCells_.end() && it->tile == tile)
+                {
+                    activeCells_.erase(it);
+                }
+            }
+
+            std::array<std::array<LayeredCell, TConfig::kBoardWidth>, TConfig::kBoardHeight> layeredCells_;
+            std::vector<ActiveCell> activeCells_;
+            CellArena *arena_;
+
+            SchedulingMode schedulingMode_;
+            std::size_t tick_;
+            int passOneCursor_;
+            std::array<ForegroundCell *, kTileCount> updatableCells_;
+            std::array<int, kTileCount> wakeTiles_;
+            std::array<std::size_t, kTileCount> lastVisitTicks_;
+            std::array<std::size_t, kTileCount> wakeTicks_;
+            std::array<std::uint64_t, (kTileCount + 63) / 64> awakeTiles_;
+            TimerWheel timerWheel_;
+
+            std::uint64_t stateHash_;
+            // GetStateHash() of the foreground whose home tile this is: its
+            // updatable tile if it has one, its top-left tile otherwise.
+            std::array<std::uint64_t, kTileCount> cellHashes_;
+            // Tick modulo kMiningInterval at which the miner at this tile was
+            // built, or kNoTimer.
+            std::array<std::uint16_t, kTileCount> timerPhases_;
+            std::size_t timerCount_;
+
+            std::size_t threadCount_;
+            // Created on the first parallel update; ForkFrom() drops it so that
+            // forks updated on other threads never share it.
+            std::shared_ptr<UpdateWorkerPool> workerPool_;
+            bool partitionsDirty_;
+            // Indices into activeCells_, in row-major order within a partition.
+            std::vector<std::vector<int>> partitions_;
+            std::vector<PartitionResult> partitionContexts_;
+            bool inParallelPass_;
+
+            // Rebuilt on the next pipelined update after any Build or Remove.
+            // ForkFrom() also marks them stale, as stages point at the cells.
+            bool pipelinesDirty_;
+            std::vector<Pipeline> pipelines_;
+            // Index into pipelines_ of the pipeline holding each tile, or
+            // kNoPipeline.
+            std::array<int, kTileCount> pipelineOfTile_;
+
+            DistanceField distanceField_;
+
+#ifdef PDOGS_PROFILE
+            EngineProfile *profile_;
+            std::array<EngineProfile::CellType, kTileCount> profiledTypes_;
+#endif
+        };
+
+        class NumberCell : public IBackgroundCell
+        {
+        public:
+            NumberCell(int number) : number_(number) {}
+
+            int GetNumber() const
+            {
+                return number_;
+            }
+
+            bool CanBuild() const override
+            {
+                return true;
+            }
+
+            void Accept(const CellVisitor *visitor) const override
+            {
+                visitor->Visit(this);
+            }
+
+            std::uint64_t GetStateHash() const override
+            {
+                return MixHash(0x60 + number_);
+            }
+
+        private:
+            int number_;
+        };
+
+        class BackgroundCellFactory
+        {
+        public:
+            BackgroundCellFactory(unsigned int seed, CellArena *arena = nullptr) : gen_(seed), arena_(arena) {}
+
+            std::shared_ptr<IBackgroundCell> Create()
+            {
+                int val = gen_() % 30;
+
+                switch (val)
+                {
+                case 1:
+                case 2:
+                case 3:
+                case 5:
+                case 7:
+                case 11:
+                    return MakeCell<NumberCell>(arena_, val);
+                default:
+                    return nullptr;
+                }
+            }
+
+        private:
+            std::mt19937 gen_;
+            CellArena *arena_;
+        };
+
+        // The NumberCells of a board, built once from its backgrounds. They can
+        // be listed by number or by residue, or searched nearest first from any
+        // tile through kBucketSize x kBucketSize buckets, so choosing where to
+        // mine never scans the whole board. The game manager keeps the
+        // buildable flag of every entry up to date as foregrounds change.
+        // Finding the entry of a tile goes through a dense per-tile array, so
+        // the index costs about five bytes per tile plus its entries.
+        class NumberCellIndex
+        {
+        public:
+            static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+            static constexpr int kBucketSize = 4;
+            static constexpr int kBucketRows = (TConfig::kBoardHeight + kBucketSize - 1) / kBucketSize;
+            static constexpr int kBucketCols = (TConfig::kBoardWidth + kBucketSize - 1) / kBucketSize;
+
+            struct Entry
+            {
+                CellPosition position;
+                int number;
+                // Whether a foreground can be built on it right now.
+                bool buildable;
+            };
+
+            NumberCellIndex() : entries_{}, entryOfTile_(kTileCount, -1), buckets_(kBucketRows * kBucketCols), numbers_{}, entriesOfNumber_{}
+            {
+            }
+
+            void Clear()
+            {
+                for (const Entry &entry : entries_)
+                {
+                    entryOfTile_[ToTile(entry.position)] = -1;
+                }
+                entries_.clear();
+                for (std::vector<int> &bucket : buckets_)
+                {
+                    bucket.clear();
+                }
+                numbers_.clear();
+                entriesOfNumber_.clear();
+            }
+
+            // Indexes the NumberCell at cellPosition, which must not be indexed
+            // yet. Entries are listed in the order they were added.
+            void Add(CellPosition cellPosition, int number)
+            {
+                assert(entryOfTile_[ToTile(cellPosition)] < 0);
+
+                const int index = static_cast<int>(entries_.size());
+                entries_.push_back({cellPosition, number, true});
+                entryOfTile_[ToTile(cellPosition)] = index;
+                buckets_[(cellPosition.row / kBucketSize) * kBucketCols + cellPosition.col / kBucketSize].push_back(index);
+
+                auto it = std::lower_bound(numbers_.begin(), numbers_.end(), number);
+                if (it == numbers_.end() || *it != number)
+                {
+                    entriesOfNumber_.insert(entriesOfNumber_.begin() + (it - numbers_.begin()), std::vector<int>());
+                    it = numbers_.insert(it, number);
+                }
+                entriesOfNumber_[it - numbers_.begin()].push_back(index);
+            }
+
+            // No-op on tiles without a NumberCell.
+            void SetBuildable(CellPosition cellPosition, bool buildable)
+            {
+                const int index = entryOfTile_[ToTile(cellPosition)];
+                if (index >= 0)
+                    entries_[index].buildable = buildable;
+            }
+
+            const std::vector<Entry> &GetEntries() const
+            {
+                return entries_;
+            }
+
+            // The entry at cellPosition, or nullptr if it has no NumberCell.
+            const Entry *Find(CellPosition cellPosition) const
+            {
+                const int index = entryOfTile_[ToTile(cellPosition)];
+                return index >= 0 ? &entries_[index] : nullptr;
+            }
+
+            // Distinct numbers on the board, ascending.
+            const std::vector<int> &GetNumbers() const
+            {
+                return numbers_;
+            }
+
+            std::vector<CellPosition> GetPositions(int number, bool buildableOnly = false) const
+            {
+                std::vector<CellPosition> positions;
+                auto it = std::lower_bound(numbers_.begin(), numbers_.end(), number);
+                if (it != numbers_.end() && *it == number)
+                {
+                    AppendPositions(entriesOfNumber_[it - numbers_.begin()], buildableOnly, positions);
+                }
+                return positions;
+            }
+
+            // Positions whose number is congruent to residue modulo divisor,
+            // grouped by number.
+            std::vector<CellPosition> GetPositionsWithResidue(int divisor, int residue, bool buildableOnly = false) const
+            {
+                std::vector<CellPosition> positions;
+                for (std::size_t i = 0; i < numbers_.size(); ++i)
+                {
+                    if (((numbers_[i] - residue) % divisor + divisor) % divisor == 0)
+                    {
+                        AppendPositions(entriesOfNumber_[i], buildableOnly, positions);
+                    }
+                }
+                return positions;
+            }
+
+            // Up to count entries for which accept(entry) holds, by increasing
+            // Manhattan distance from cellPosition and then in the order they
+            // were added. Buckets are visited in square rings around
+            // cellPosition until no unvisited bucket can hold a closer entry.
+            template <typename TAccept>
+            std::vector<const Entry *> FindNearest(CellPosition cellPosition, std::size_t count, TAccept accept) const
+            {
+                std::vector<std::pair<int, int>> found;
+                if (count == 0)
+                    return {};
+
+                const int centerRow = cellPosition.row / kBucketSize;
+                const int centerCol = cellPosition.col / kBucketSize;
+                auto visit = [&](int row, int col) {
+                    if (row < 0 || row >= kBucketRows || col < 0 || col >= kBucketCols)
+                        return;
+                    for (int index : buckets_[row * kBucketCols + col])
+                    {
+                        const Entry &entry = entries_[index];
+                        if (accept(entry))
+                        {
+                            const int distance = std::abs(entry.position.row - cellPosition.row) +
+                                                 std::abs(entry.position.col - cellPosition.col);
+                            found.push_back({distance, index});
+                        }
+                    }
+                };
+
+                for (int ring = 0;; ++ring)
+                {
+                    if (ring == 0)
+                    {
+                        visit(centerRow, centerCol);
+                    }
+                    for (int k = -ring; ring > 0 && k <= ring; ++k)
+                    {
+                        visit(centerRow - ring, centerCol + k);
+                        visit(centerRow + ring, centerCol + k);
+                        if (k != -ring && k != ring)
+                        {
+                            visit(centerRow + k, centerCol - ring);
+                            visit(centerRow + k, centerCol + ring);
+                        }
+                    }
+
+                    // The closest tile outside the visited square, if any is
+                    // left on the board.
+                    int bound = std::numeric_limits<int>::max();
+                    if (centerRow - ring > 0)
+                        bound = std::min(bound, cellPosition.row - (centerRow - ring) * kBucketSize + 1);
+                    if (centerRow + ring + 1 < kBucketRows)
+                        bound = std::min(bound, (centerRow + ring + 1) * kBucketSize - cellPosition.row);
+                    if (centerCol - ring > 0)
+                        bound = std::min(bound, cellPosition.col - (centerCol - ring) * kBucketSize + 1);
+                    if (centerCol + ring + 1 < kBucketCols)
+                        bound = std::min(bound, (centerCol + ring + 1) * kBucketSize - cellPosition.col);
+
+                    if (found.size() >= count)
+                    {
+                        std::nth_element(found.begin(), found.begin() + (count - 1), found.end());
+                        if (found[count - 1].first < bound)
+                            break;
+                    }
+                    if (bound == std::numeric_limits<int>::max())
+                        break;
+                }
+
+                found.resize(std::min(found.size(), count));
+                std::sort(found.begin(), found.end());
+                std::vector<const Entry *> nearest;
+                nearest.reserve(found.size());
+                for (const auto &item : found)
+                {
+                    nearest.push_back(&entries_[item.second]);
+                }
+                return nearest;
+            }
+
+        private:
+            static int ToTile(CellPosition cellPosition)
+            {
+                return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+            }
+
+            void AppendPositions(const std::vector<int> &indices, bool buildableOnly, std::vector<CellPosition> &positions) const
+            {
+                for (int index : indices)
+                {
+                    if (!buildableOnly || entries_[index].buildable)
+                        positions.push_back(entries_[index].position);
+                }
+            }
+
+            std::vector<Entry> entries_;
+            std::vector<int> entryOfTile_;
+            // Indices into entries_ of the tiles of each bucket, row-major.
+            std::vector<std::vector<int>> buckets_;
+            std::vector<int> numbers_;
+            // Indices into entries_ with numbers_[i], parallel to numbers_.
+            std::vector<std::vector<int>> entriesOfNumber_;
+        };
+
+        class MiningMachineCell : public ForegroundCell
+        {
+        public:
+            MiningMachineCell(CellPosition topLeft, Direction direction)
+                : ForegroundCell(topLeft), direction_{direction}, elapsedTime_{0}, minedNumber_{0} {}
+
+            Direction GetDirection() const { return direction_; }
+
+            // The number this machine extracts, or 0 if it does not stand on a
+            // NumberCell. Resolved once by the board when the machine is built.
+            int GetMinedNumber() const { return minedNumber_; }
+
+            void ResolveMinedNumber(const LayeredCell &layeredCell)
+            {
+                auto numberCell = dynamic_cast<const NumberCell *>(layeredCell.GetBackground().get());
+                minedNumber_ = numberCell ? numberCell->GetNumber() : 0;
+            }
+
+            void Accept(const CellVisitor *visitor) const override
+            {
+                visitor->Visit(this);
+            }
+
+            bool CanRemove() const override
+            {
+                return true;
+            }
+            bool IsUpdatable(CellPosition cellPosition) const override
+            {
+                return true;
+            }
+            bool GetOutputDirection(Direction &direction) const override
+            {
+                direction = direction_;
+                return true;
+            }
+            std::size_t GetCapacity(CellPosition cellPosition) const override
+            {
+                return 0;
+            }
+            void ReceiveProduct(CellPosition cellPosition, int number) override
+            {
+            }
+            void UpdatePassOne(CellPosition cellPosition, GameBoard &board) override
+            {
+                RunPassOne(cellPosition, board);
+            }
+            template <typename TGameBoard>
+            void RunPassOne(CellPosition cellPosition, TGameBoard &board)
+            {
+                ++elapsedTime_;
+                if (elapsedTime_ >= TConfig::kMiningInterval)
+                {
+                    if (minedNumber_ != 0 && GetNeighborCapacity(board, cellPosition, direction_) >= 3)
+                    {
+                        SendProduct(board, cellPosition, direction_, minedNumber_);
+                    }
+
+                    elapsedTime_ = 0;
+                }
+            }
+            std::size_t GetIdleTicks(CellPosition cellPosition) const override
+            {
+                return TConfig::kMiningInterval - 1 - elapsedTime_;
+            }
+            void SkipTicks(std::size_t ticks) override
+            {
+                elapsedTime_ += ticks;
+            }
+            void AppendState(CellPosition cellPosition, std::vector<int> &state) const override
+            {
+                state.push_back(static_cast<int>(elapsedTime_));
+            }
+            const int *ReadState(CellPosition cellPosition, const int *state) override
+            {
+                if (state[0] < 0 || state[0] >= static_cast<int>(TConfig::kMiningInterval))
+                    return nullptr;
+                elapsedTime_ = static_cast<std::size_t>(state[0]);
+                return state + 1;
+            }
+            std::shared_ptr<ForegroundCell> Clone(IGameManager *gameManager) const override
+            {
+                return std::make_shared<MiningMachineCell>(*this);
+            }
+            std::uint64_t GetStateHash() const override
+            {
+                return MixHash(0x30 + static_cast<int>(direction_));
+            }
+        private:
+            friend class FlatGameBoard;
+
+            Direction direction_;
+            std::size_t elapsedTime_;
+            int minedNumber_;
+        };
+
+        // Struct-of-arrays board engine. Cell kind, direction, miner timer and
+        // conveyor/combiner slots live in flat arrays indexed by tile
+        // (row * kBoardWidth + col), so Update() never chases a cell pointer.
+        // The ForegroundCell objects are only kept as a view layer for
+        // GetLayeredCell() and are refreshed from the arrays when accessed.
+        // Reading a cell therefore writes its view, so a board must not be
+        // read from several threads at once. Forking it never writes it, so
+        // forks may be taken concurrently.
+        class FlatGameBoard
+        {
+        public:
+            enum class CellKind : std::uint8_t
+            {
+                kEmpty,
+                kWall,
+                kCollectionCenter,
+                kMiningMachine,
+                kConveyor,
+                kCombiner
+            };
+
+            static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+            static constexpr std::size_t kSlotCount = TConfig::kConveyorBufferSize;
+
+            FlatGameBoard()
+                : kinds_{}, directions_{}, targets_{}, partners_{}, timers_{}, minedNumbers_{}, combinerSlots_{}, conveyors_{}, gameManager_{},
+                  arena_{}, distanceField_{}
+            {
+            }
+
+            // Only the view cells are allocated; the simulation state is flat.
+            void SetArena(CellArena *arena)
+            {
+                arena_ = arena;
+            }
+
+            // Per-cell counters are only collected by GameBoard.
+            void SetProfile(EngineProfile *)
+            {
+            }
+
+            void Clear()
+            {
+                kinds_.fill(CellKind::kEmpty);
+                timers_.fill(0);
+                combinerSlots_.fill(0);
+                for (ConveyorBuffer &conveyor : conveyors_)
+                {
+                    conveyor.Clear();
+                }
+                activeTiles_.clear();
+                view_.fill(LayeredCell());
+                distanceField_.Clear();
+            }
+
+            // Makes this board an independent copy of source for a forked game
+            // owned by gameManager. The flat state is copied; the view cells are
+            // cloned so that syncing them never touches source's views.
+            void ForkFrom(const FlatGameBoard &source, IGameManager *gameManager)
+            {
+                *this = source;
+                gameManager_ = gameManager;
+                arena_ = nullptr;
+
+                for (int tile = 0; tile < kTileCount; ++tile)
+                {
+                    CloneForeground(ToPosition(tile), gameManager, [this](CellPosition position) -> LayeredCell & {
+                        return view_[ToTile(position)];
+                    });
+                }
+            }
+
+            // Not safe to call concurrently; see the class comment.
+            const LayeredCell &GetLayeredCell(CellPosition cellPosition) const
+            {
+                const int tile = ToTile(cellPosition);
+                SyncView(tile);
+                return view_[tile];
+            }
+
+            CellKind GetCellKind(CellPosition cellPosition) const
+            {
+                return kinds_[ToTile(cellPosition)];
+            }
+
+            bool CanBuild(const ForegroundCell &cell) const
+            {
+                CellPosition cellPosition = cell.GetTopLeftCellPosition();
+
+                if (cellPosition.col < 0 || cellPosition.col + cell.GetWidth() > TConfig::kBoardWidth ||
+                    cellPosition.row < 0 || cellPosition.row + cell.GetHeight() > TConfig::kBoardHeight)
+                {
+                    return false;
+                }
+
+                for (std::size_t i = 0; i < cell.GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < cell.GetWidth(); ++j)
+                    {
+                        if (!view_[ToTile(cellPosition + CellPosition{static_cast<int>(i), static_cast<int>(j)})].CanBuild())
+                        {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+            template <typename TCell, typename... TArgs>
+            bool Build(CellPosition cellPosition, TArgs... args)
+            {
+                TCell probe(cellPosition, args...);
+                if (!CanBuild(probe))
+                    return false;
+
+                auto cell = MakeCell<TCell>(arena_, probe);
+
+                CellPosition topLeft = cell->GetTopLeftCellPosition();
+
+                if constexpr (std::is_same<TCell, MiningMachineCell>::value)
+                {
+                    cell->ResolveMinedNumber(view_[ToTile(topLeft)]);
+                }
+
+                for (std::size_t i = 0; i < cell->GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < cell->GetWidth(); ++j)
+                    {
+                        CellPosition position = topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)};
+                        view_[ToTile(position)].SetForegrund(cell);
+                        Place(*cell, position);
+                        distanceField_.template OnBuilt<TCell>(position, *this);
+                    }
+                }
+                return true;
+            }
+
+            void Remove(CellPosition cellPosition)
+            {
+                auto foreground = view_[ToTile(cellPosition)].GetForeground();
+
+                if (foreground == nullptr || !foreground->CanRemove())
+                    return;
+
+                CellPosition topLeft = foreground->GetTopLeftCellPosition();
+
+                for (std::size_t i = 0; i < foreground->GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < foreground->GetWidth(); ++j)
+                    {
+                        const int tile = ToTile(topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)});
+                        Deactivate(tile);
+                        kinds_[tile] = CellKind::kEmpty;
+                        timers_[tile] = 0;
+                        combinerSlots_[tile] = 0;
+                        conveyors_[tile].Clear();
+                        view_[tile].SetForegrund(nullptr);
+                        distanceField_.Open(ToPosition(tile), *this);
+                    }
+                }
+            }
+
+            void SetBackground(CellPosition cellPosition, std::shared_ptr<IBackgroundCell> value)
+            {
+                const bool couldBuild = view_[ToTile(cellPosition)].CanBuild();
+                view_[ToTile(cellPosition)].SetBackground(value);
+                distanceField_.OnBackgroundChanged(cellPosition, couldBuild, *this);
+            }
+
+            // See DistanceField::Get().
+            int GetDistanceToCollectionCenter(CellPosition cellPosition) const
+            {
+                return distanceField_.Get(cellPosition);
+            }
+
+            void GetState(std::vector<int> &state) const
+            {
+                state.clear();
+                for (int tile : activeTiles_)
+                {
+                    state.push_back(tile);
+                    switch (kinds_[tile])
+                    {
+                    case CellKind::kConveyor:
+                        state.insert(state.end(), conveyors_[tile].begin(), conveyors_[tile].end());
+                        break;
+                    case CellKind::kMiningMachine:
+                        state.push_back(timers_[tile]);
+                        break;
+                    case CellKind::kCombiner:
+                        state.push_back(combinerSlots_[tile]);
+                        state.push_back(combinerSlots_[partners_[tile]]);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+
+            // Restores a GetState() of a board on which the same cells were built.
+            // Returns false if state does not fit the cells of this board; the
+            // cells before the mismatch are restored all the same.
+            bool SetState(const std::vector<int> &state)
+            {
+                const int *it = state.data();
+                const int *end = it + state.size();
+                while (it != end)
+                {
+                    const int tile = *it++;
+                    if (!std::binary_search(activeTiles_.begin(), activeTiles_.end(), tile))
+                        return false;
+
+                    switch (kinds_[tile])
+                    {
+                    case CellKind::kConveyor:
+                        if (end - it < static_cast<std::ptrdiff_t>(kSlotCount))
+                            return false;
+                        conveyors_[tile].Assign(it);
+                        it += kSlotCount;
+                        break;
+                    case CellKind::kMiningMachine:
+                        if (end - it < 1 || *it < 0 || *it >= static_cast<int>(TConfig::kMiningInterval))
+                            return false;
+                        timers_[tile] = static_cast<std::uint16_t>(*it++);
+                        break;
+                    case CellKind::kCombiner:
+                        if (end - it < 2)
+                            return false;
+                        combinerSlots_[tile] = it[0];
+                        combinerSlots_[partners_[tile]] = it[1];
+                        it += 2;
+                        break;
+                    default:
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // The board keeps no clock: GetStateHash() follows from GetState().
+            void GetClock(std::vector<int> &clock) const
+            {
+                clock.clear();
+            }
+
+            bool SetClock(const std::vector<int> &)
+            {
+                return true;
+            }
+
+            // Not maintained incrementally: hashes GetState(), O(active tiles).
+            std::uint64_t GetStateHash() const
+            {
+                std::vector<int> state;
+                GetState(state);
+                return HashState(state);
+            }
+
+            void Update()
+            {
+                for (int tile : activeTiles_)
+                {
+                    switch (kinds_[tile])
+                    {
+                    case CellKind::kConveyor:
+                        UpdateConveyorPassOne(tile);
+                        break;
+                    case CellKind::kMiningMachine:
+                        UpdateMiningMachine(tile);
+                        break;
+                    case CellKind::kCombiner:
+                        UpdateCombiner(tile);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                for (int tile : activeTiles_)
+                {
+                    if (kinds_[tile] == CellKind::kConveyor)
+                    {
+                        UpdateConveyorPassTwo(tile);
+                    }
+                }
+            }
+
+        private:
+            static int ToTile(CellPosition cellPosition)
+            {
+                return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+            }
+
+            static int GetTargetTile(CellPosition cellPosition, Direction direction)
+            {
+                CellPosition target = GetNeighborCellPosition(cellPosition, direction);
+                return IsWithinBoard(target) ? ToTile(target) : -1;
+            }
+
+            void Place(const WallCell &cell, CellPosition cellPosition)
+            {
+                kinds_[ToTile(cellPosition)] = CellKind::kWall;
+            }
+
+            void Place(const CollectionCenterCell &cell, CellPosition cellPosition)
+            {
+                kinds_[ToTile(cellPosition)] = CellKind::kCollectionCenter;
+                gameManager_ = cell.gameManager_;
+            }
+
+            void Place(const MiningMachineCell &cell, CellPosition cellPosition)
+            {
+                const int tile = ToTile(cellPosition);
+                kinds_[tile] = CellKind::kMiningMachine;
+                directions_[tile] = cell.GetDirection();
+                targets_[tile] = GetTargetTile(cellPosition, cell.GetDirection());
+                timers_[tile] = 0;
+                minedNumbers_[tile] = cell.GetMinedNumber();
+                Activate(tile);
+            }
+
+            void Place(const ConveyorCell &cell, CellPosition cellPosition)
+            {
+                const int tile = ToTile(cellPosition);
+                kinds_[tile] = CellKind::kConveyor;
+                directions_[tile] = cell.GetDirection();
+                targets_[tile] = GetTargetTile(cellPosition, cell.GetDirection());
+                Activate(tile);
+            }
+
+            void Place(const CombinerCell &cell, CellPosition cellPosition)
+            {
+                const int tile = ToTile(cellPosition);
+                const bool horizontal = cell.GetWidth() == 2;
+                const CellPosition topLeft = cell.GetTopLeftCellPosition();
+                const CellPosition other = topLeft + (horizontal ? CellPosition{0, 1} : CellPosition{1, 0});
+
+                kinds_[tile] = CellKind::kCombiner;
+                directions_[tile] = cell.GetDirection();
+                targets_[tile] = GetTargetTile(cellPosition, cell.GetDirection());
+                partners_[tile] = ToTile(cellPosition == topLeft ? other : topLeft);
+
+                if (cell.IsMainCell(cellPosition))
+                {
+                    Activate(tile);
+                }
+            }
+
+            void Activate(int tile)
+            {
+                activeTiles_.insert(std::lower_bound(activeTiles_.begin(), activeTiles_.end(), tile), tile);
+            }
+
+            void Deactivate(int tile)
+            {
+                auto it = std::lower_bound(activeTiles_.begin(), activeTiles_.end(), tile);
+                if (it != activeTiles_.end() && *it == tile)
+                {
+                    activeTiles_.erase(it);
+                }
+            }
+
+            std::size_t GetCapacity(int tile) const
+            {
+                if (tile < 0)
+                    return 0;
+
+                switch (kinds_[tile])
+                {
+                case CellKind::kConveyor:
+                    return conveyors_[tile].GetCapacity();
+                case CellKind::kCombiner:
+                    return combinerSlots_[tile] == 0 ? kSlotCount : 0;
+                case CellKind::kCollectionCenter:
+                    return kSlotCount;
+                default:
+                    return 0;
+                }
+            }
+
+            void Send(int tile, int number)
+            {
+                if (tile < 0)
+                    return;
+
+                switch (kinds_[tile])
+                {
+                case CellKind::kConveyor:
+                    conveyors_[tile].Receive(number);
+                    break;
+                case CellKind::kCombiner:
+                    combinerSlots_[tile] = number;
+                    break;
+                case CellKind::kCollectionCenter:
+                    gameManager_->OnProductReceived(number);
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            void UpdateConveyorPassOne(int tile)
+            {
+                if (int product = conveyors_[tile].AdvanceFront(GetCapacity(targets_[tile])))
+                {
+                    Send(targets_[tile], product);
+                }
+            }
+
+            void UpdateConveyorPassTwo(int tile)
+            {
+                conveyors_[tile].AdvanceBack();
+            }
+
+            void UpdateMiningMachine(int tile)
+            {
+                if (++timers_[tile] >= TConfig::kMiningInterval)
+                {
+                    if (minedNumbers_[tile] != 0 && GetCapacity(targets_[tile]) >= 3)
+                    {
+                        Send(targets_[tile], minedNumbers_[tile]);
+                    }
+                    timers_[tile] = 0;
+                }
+            }
+
+            void UpdateCombiner(int tile)
+            {
+                int &first = combinerSlots_[tile];
+                int &second = combinerSlots_[partners_[tile]];
+
+                if (first != 0 && second != 0 && GetCapacity(targets_[tile]) >= 3)
+                {
+                    Send(targets_[tile], first + second);
+                    first = 0;
+                    second = 0;
+                }
+            }
+
+            void SyncView(int tile) const
+            {
+                ForegroundCell *foreground = view_[tile].GetForeground().get();
+
+                switch (kinds_[tile])
+                {
+                case CellKind::kConveyor:
+                    static_cast<ConveyorCell *>(foreground)->products_ = conveyors_[tile];
+                    break;
+                case CellKind::kCombiner:
+                {
+                    auto combiner = static_cast<CombinerCell *>(foreground);
+                    const bool isMain = combiner->IsMainCell(ToPosition(tile));
+                    const int mainTile = isMain ? tile : partners_[tile];
+                    combiner->firstSlotProduct_ = combinerSlots_[mainTile];
+                    combiner->secondSlotProduct_ = combinerSlots_[partners_[mainTile]];
+                    break;
+                }
+                case CellKind::kMiningMachine:
+                    static_cast<MiningMachineCell *>(foreground)->elapsedTime_ = timers_[tile];
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            static CellPosition ToPosition(int tile)
+            {
+                return {tile / TConfig::kBoardWidth, tile % TConfig::kBoardWidth};
+            }
+
+            std::array<CellKind, kTileCount> kinds_;
+            std::array<Direction, kTileCount> directions_;
+            std::array<int, kTileCount> targets_;
+            std::array<int, kTileCount> partners_;
+            std::array<std::uint16_t, kTileCount> timers_;
+            std::array<int, kTileCount> minedNumbers_;
+            std::array<int, kTileCount> combinerSlots_;
+            std::array<ConveyorBuffer, kTileCount> conveyors_;
+            std::vector<int> activeTiles_;
+            IGameManager *gameManager_;
+            CellArena *arena_;
+            // Synced lazily by const reads.
+            mutable std::array<LayeredCell, kTileCount> view_;
+            DistanceField distanceField_;
+        };
+
+        // Closed-world board engine. Every foreground cell is stored by value in
+        // a std::variant over the five cell types and Update() dispatches with
+        // std::visit, so cell logic is called without virtual dispatch and can be
+        // inlined. The LayeredCell views hold non-owning pointers to those same
+        // cells, which keeps CellVisitor-based code (renderers, players) working.
+        class VariantGameBoard
+        {
+        public:
+            using CellVariant =
+                std::variant<std::monostate, ConveyorCell, CombinerCell, MiningMachineCell, WallCell, CollectionCenterCell>;
+
+            static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+
+            VariantGameBoard() : cells_(kTileCount), owners_{}, activeCells_{}, view_{}, distanceField_{}
+            {
+                owners_.fill(-1);
+            }
+
+            // The views point into cells_, so a copy would alias the original.
+            VariantGameBoard(const VariantGameBoard &) = delete;
+            VariantGameBoard &operator=(const VariantGameBoard &) = delete;
+
+            // Cells are stored by value in cells_, which already is an arena.
+            void SetArena(CellArena *)
+            {
+            }
+
+            // Per-cell counters are only collected by GameBoard.
+            void SetProfile(EngineProfile *)
+            {
+            }
+
+            void Clear()
+            {
+                std::fill(cells_.begin(), cells_.end(), CellVariant{});
+                owners_.fill(-1);
+                activeCells_.clear();
+                view_.fill(LayeredCell());
+                distanceField_.Clear();
+            }
+
+            // Makes this board an independent copy of source for a forked game
+            // owned by gameManager. Cells are copied by value and the views are
+            // re-pointed at the copies.
+            void ForkFrom(const VariantGameBoard &source, IGameManager *gameManager)
+            {
+                cells_ = source.cells_;
+                owners_ = source.owners_;
+                activeCells_ = source.activeCells_;
+                view_ = source.view_;
+                distanceField_ = source.distanceField_;
+
+                for (int tile = 0; tile < kTileCount; ++tile)
+                {
+                    const int owner = owners_[tile];
+                    if (owner < 0)
+                        continue;
+
+                    if (auto *collectionCenter = std::get_if<CollectionCenterCell>(&cells_[owner]))
+                    {
+                        if (owner == tile)
+                            *collectionCenter = CollectionCenterCell(collectionCenter->GetTopLeftCellPosition(), gameManager);
+                    }
+                    std::visit(
+                        [this, tile](auto &cell) {
+                            using TCell = std::decay_t<decltype(cell)>;
+                            if constexpr (!std::is_same<TCell, std::monostate>::value)
+                            {
+                                view_[tile].SetForegrund(std::shared_ptr<ForegroundCell>(std::shared_ptr<ForegroundCell>(), &cell));
+                            }
+                        },
+                        cells_[owner]);
+                }
+            }
+
+            const LayeredCell &GetLayeredCell(CellPosition cellPosition) const
+            {
+                return view_[ToTile(cellPosition)];
+            }
+
+            // Calls function with the concrete cell at cellPosition (or
+            // std::monostate), resolved at compile time per alternative.
+            template <typename TFunction>
+            decltype(auto) VisitCell(CellPosition cellPosition, TFunction &&function) const
+            {
+                static const CellVariant empty;
+                const int owner = owners_[ToTile(cellPosition)];
+                return std::visit(std::forward<TFunction>(function), owner < 0 ? empty : cells_[owner]);
+            }
+
+            bool CanBuild(const ForegroundCell &cell) const
+            {
+                CellPosition cellPosition = cell.GetTopLeftCellPosition();
+
+                if (cellPosition.col < 0 || cellPosition.col + cell.GetWidth() > TConfig::kBoardWidth ||
+                    cellPosition.row < 0 || cellPosition.row + cell.GetHeight() > TConfig::kBoardHeight)
+                {
+                    return false;
+                }
+
+                for (std::size_t i = 0; i < cell.GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < cell.GetWidth(); ++j)
+                    {
+                        if (!view_[ToTile(cellPosition + CellPosition{static_cast<int>(i), static_cast<int>(j)})].CanBuild())
+                        {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+            template <typename TCell, typename... TArgs>
+            bool Build(CellPosition cellPosition, TArgs... args)
+            {
+                TCell cell(cellPosition, args...);
+                if (!CanBuild(cell))
+                    return false;
+
+                const CellPosition topLeft = cell.GetTopLeftCellPosition();
+
+                if constexpr (std::is_same<TCell, MiningMachineCell>::value)
+                {
+                    cell.ResolveMinedNumber(view_[ToTile(topLeft)]);
+                }
+                const int owner = ToTile(topLeft);
+                TCell &stored = cells_[owner].template emplace<TCell>(cell);
+                const std::shared_ptr<ForegroundCell> view(std::shared_ptr<ForegroundCell>(), &stored);
+
+                for (std::size_t i = 0; i < stored.GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < stored.GetWidth(); ++j)
+                    {
+                        CellPosition position = topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)};
+                        const int tile = ToTile(position);
+                        owners_[tile] = owner;
+                        view_[tile].SetForegrund(view);
+                        distanceField_.template OnBuilt<TCell>(position, *this);
+                        if (stored.TCell::IsUpdatable(position))
+                        {
+                            activeCells_.insert(FindActiveCell(tile), ActiveCell{tile, owner, position});
+                        }
+                    }
+                }
+                return true;
+            }
+
+            void Remove(CellPosition cellPosition)
+            {
+                const ForegroundCell *foreground = view_[ToTile(cellPosition)].GetForeground().get();
+
+                if (foreground == nullptr || !foreground->CanRemove())
+                    return;
+
+                const CellPosition topLeft = foreground->GetTopLeftCellPosition();
+                const std::size_t height = foreground->GetHeight();
+                const std::size_t width = foreground->GetWidth();
+
+                for (std::size_t i = 0; i < height; ++i)
+                {
+                    for (std::size_t j = 0; j < width; ++j)
+                    {
+                        const CellPosition position = topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)};
+                        const int tile = ToTile(position);
+                        owners_[tile] = -1;
+                        view_[tile].SetForegrund(nullptr);
+                        distanceField_.Open(position, *this);
+                        auto it = FindActiveCell(tile);
+                        if (it != activeCells_.end() && it->tile == tile)
+                        {
+                            activeCells_.erase(it);
+                        }
+                    }
+                }
+                cells_[ToTile(topLeft)] = std::monostate{};
+            }
+
+            void SetBackground(CellPosition cellPosition, std::shared_ptr<IBackgroundCell> value)
+            {
+                const bool couldBuild = view_[ToTile(cellPosition)].CanBuild();
+                view_[ToTile(cellPosition)].SetBackground(value);
+                distanceField_.OnBackgroundChanged(cellPosition, couldBuild, *this);
+            }
+
+            // See DistanceField::Get().
+            int GetDistanceToCollectionCenter(CellPosition cellPosition) const
+            {
+                return distanceField_.Get(cellPosition);
+            }
+
+            std::size_t GetCapacity(CellPosition cellPosition) const
+            {
+                const int owner = owners_[ToTile(cellPosition)];
+                if (owner < 0)
+                    return 0;
+
+                return std::visit([cellPosition](const auto &cell) { return GetCellCapacity(cell, cellPosition); }, cells_[owner]);
+            }
+
+            void ReceiveProduct(CellPosition cellPosition, int number)
+            {
+                const int owner = owners_[ToTile(cellPosition)];
+                if (owner < 0)
+                    return;
+
+                std::visit([cellPosition, number](auto &cell) { ReceiveCellProduct(cell, cellPosition, number); }, cells_[owner]);
+            }
+
+            void GetState(std::vector<int> &state) const
+            {
+                state.clear();
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    state.push_back(activeCell.tile);
+                    std::visit([&](const auto &cell) { AppendCellState(cell, activeCell.position, state); }, cells_[activeCell.owner]);
+                }
+            }
+
+            // Restores a GetState() of a board on which the same cells were built.
+            // Returns false if state does not fit the cells of this board; the
+            // cells before the mismatch are restored all the same.
+            bool SetState(const std::vector<int> &state)
+            {
+                std::vector<int> expected;
+                const int *it = state.data();
+                const int *end = it + state.size();
+                while (it != end)
+                {
+                    const int tile = *it++;
+                    auto activeCell = FindActiveCell(tile);
+                    if (activeCell == activeCells_.end() || activeCell->tile != tile)
+                        return false;
+
+                    CellVariant &cell = cells_[activeCell->owner];
+                    const CellPosition position = activeCell->position;
+                    expected.clear();
+                    std::visit([&](const auto &value) { AppendCellState(value, position, expected); }, cell);
+                    if (end - it < static_cast<std::ptrdiff_t>(expected.size()))
+                        return false;
+
+                    it = std::visit([&](auto &value) { return ReadCellState(value, position, it); }, cell);
+                    if (it == nullptr)
+                        return false;
+                }
+                return true;
+            }
+
+            // The board keeps no clock: GetStateHash() follows from GetState().
+            void GetClock(std::vector<int> &clock) const
+            {
+                clock.clear();
+            }
+
+            bool SetClock(const std::vector<int> &)
+            {
+                return true;
+            }
+
+            // Not maintained incrementally: hashes GetState(), O(active tiles).
+            std::uint64_t GetStateHash() const
+            {
+                std::vector<int> state;
+                GetState(state);
+                return HashState(state);
+            }
+
+            void Update()
+            {
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    std::visit([&](auto &cell) { RunPassOne(cell, activeCell.position); }, cells_[activeCell.owner]);
+                }
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    std::visit([&](auto &cell) { RunPassTwo(cell, activeCell.position); }, cells_[activeCell.owner]);
+                }
+            }
+
+        private:
+            struct ActiveCell
+            {
+                int tile;
+                int owner;
+                CellPosition position;
+            };
+
+            static int ToTile(CellPosition cellPosition)
+            {
+                return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+            }
+
+            typename std::vector<ActiveCell>::iterator FindActiveCell(int tile)
+            {
+                return std::lower_bound(
+                    activeCells_.begin(), activeCells_.end(), tile,
+                    [](const ActiveCell &activeCell, int value) { return activeCell.tile < value; });
+            }
+
+            // Qualified calls (cell.TCell::...) bypass the vtable.
+            template <typename TCell>
+            static std::size_t GetCellCapacity(const TCell &cell, CellPosition cellPosition)
+            {
+                return cell.TCell::GetCapacity(cellPosition);
+            }
+
+            static std::size_t GetCellCapacity(const std::monostate &, CellPosition)
+            {
+                return 0;
+            }
+
+            template <typename TCell>
+            static void ReceiveCellProduct(TCell &cell, CellPosition cellPosition, int number)
+            {
+                cell.TCell::ReceiveProduct(cellPosition, number);
+            }
+
+            static void ReceiveCellProduct(std::monostate &, CellPosition, int)
+            {
+            }
+
+            template <typename TCell>
+            static void AppendCellState(const TCell &cell, CellPosition cellPosition, std::vector<int> &state)
+            {
+                cell.TCell::AppendState(cellPosition, state);
+            }
+
+            static void AppendCellState(const std::monostate &, CellPosition, std::vector<int> &)
+            {
+            }
+
+            template <typename TCell>
+            static const int *ReadCellState(TCell &cell, CellPosition cellPosition, const int *state)
+            {
+                return cell.TCell::ReadState(cellPosition, state);
+            }
+
+            static const int *ReadCellState(std::monostate &, CellPosition, const int *state)
+            {
+                return state;
+            }
+
+            void RunPassOne(ConveyorCell &cell, CellPosition cellPosition)
+            {
+                cell.RunPassOne(cellPosition, *this);
+            }
+
+            void RunPassOne(CombinerCell &cell, CellPosition cellPosition)
+            {
+                cell.RunPassOne(cellPosition, *this);
+            }
+
+            void RunPassOne(MiningMachineCell &cell, CellPosition cellPosition)
+            {
+                cell.RunPassOne(cellPosition, *this);
+            }
+
+            template <typename TCell>
+            void RunPassOne(TCell &, CellPosition)
+            {
+            }
+
+            void RunPassTwo(ConveyorCell &cell, CellPosition cellPosition)
+            {
+                cell.RunPassTwo(cellPosition, *this);
+            }
+
+            template <typename TCell>
+            void RunPassTwo(TCell &, CellPosition)
+            {
+            }
+
+            std::vector<CellVariant> cells_;
+            std::array<int, kTileCount> owners_;
+            std::vector<ActiveCell> activeCells_;
+            std::array<LayeredCell, kTileCount> view_;
+            DistanceField distanceField_;
+        };
+
+        // Sparse board engine for large maps. Foreground cells are stored by
+        // value, as in VariantGameBoard, but in 32x32 chunks that are only
+        // allocated while something is built on them; an empty chunk is
+        // released again. Backgrounds are a byte grid of NumberCell numbers,
+        // viewed through one shared LayeredCell per number, so a tile without
+        // a chunk costs a single byte. Walls are stateless and never removed,
+        // so they are a bit per tile, viewed through one shared WallCell whose
+        // GetTopLeftCellPosition() is that of no tile in particular. Update()
+        // walks the active cells, which all lie in live chunks, in row-major
+        // order. The distance field and the manager's NumberCellIndex stay
+        // dense, about ten bytes per tile, and generating the map visits every
+        // tile, so construction still follows the map size.
+        class ChunkedGameBoard
+        {
+        public:
+            using CellVariant = typename VariantGameBoard::CellVariant;
+
+            static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+            static constexpr int kChunkSize = 32;
+            static constexpr int kChunkRows = (TConfig::kBoardHeight + kChunkSize - 1) / kChunkSize;
+            static constexpr int kChunkCols = (TConfig::kBoardWidth + kChunkSize - 1) / kChunkSize;
+
+            ChunkedGameBoard()
+                : chunks_(kChunkRows * kChunkCols), backgrounds_(kTileCount), walls_((kTileCount + 63) / 64), palette_{},
+                  wallPalette_{}, activeCells_{}, distanceField_{}
+            {
+                const auto wall = std::make_shared<WallCell>(CellPosition{0, 0});
+                for (LayeredCell &view : wallPalette_)
+                {
+                    view.SetForegrund(wall);
+                }
+            }
+
+            // The views point into the chunks, so a copy would alias the original.
+            ChunkedGameBoard(const ChunkedGameBoard &) = delete;
+            ChunkedGameBoard &operator=(const ChunkedGameBoard &) = delete;
+
+            // Cells are stored by value in their chunks.
+            void SetArena(CellArena *)
+            {
+            }
+
+            // Per-cell counters are only collected by GameBoard.
+            void SetProfile(EngineProfile *)
+            {
+            }
+
+            void Clear()
+            {
+                std::fill(chunks_.begin(), chunks_.end(), nullptr);
+                std::fill(backgrounds_.begin(), backgrounds_.end(), 0);
+                std::fill(walls_.begin(), walls_.end(), 0);
+                activeCells_.clear();
+                distanceField_.Clear();
+            }
+
+            // Makes this board an independent copy of source for a forked game
+            // owned by gameManager. Live chunks are copied and their views are
+            // re-pointed at the copies.
+            void ForkFrom(const ChunkedGameBoard &source, IGameManager *gameManager)
+            {
+                for (std::size_t i = 0; i < chunks_.size(); ++i)
+                {
+                    chunks_[i] = source.chunks_[i] != nullptr ? std::make_unique<Chunk>(*source.chunks_[i]) : nullptr;
+                }
+                backgrounds_ = source.backgrounds_;
+                walls_ = source.walls_;
+                palette_ = source.palette_;
+                wallPalette_ = source.wallPalette_;
+                distanceField_ = source.distanceField_;
+
+                for (int chunkIndex = 0; chunkIndex < static_cast<int>(chunks_.size()); ++chunkIndex)
+                {
+                    Chunk *chunk = chunks_[chunkIndex].get();
+                    if (chunk == nullptr)
+                        continue;
+
+                    for (int local = 0; local < kChunkSize * kChunkSize; ++local)
+                    {
+                        const int owner = chunk->owners[local];
+                        if (owner < 0)
+                            continue;
+
+                        CellVariant &cell = GetOwnerCell(owner);
+                        auto *collectionCenter = std::get_if<CollectionCenterCell>(&cell);
+                        if (collectionCenter != nullptr && &cell == &chunk->cells[local])
+                        {
+                            *collectionCenter = CollectionCenterCell(collectionCenter->GetTopLeftCellPosition(), gameManager);
+                        }
+                        chunk->views[local].SetForegrund(ViewOf(cell));
+                    }
+                }
+
+                activeCells_ = source.activeCells_;
+                for (ActiveCell &activeCell : activeCells_)
+                {
+                    activeCell.cell = &GetOwnerCell(activeCell.owner);
+                }
+            }
+
+            const LayeredCell &GetLayeredCell(CellPosition cellPosition) const
+            {
+                const Chunk *chunk = chunks_[ToChunkIndex(cellPosition)].get();
+                return chunk != nullptr ? chunk->views[ToLocalTile(cellPosition)] : GetSharedView(ToTile(cellPosition));
+            }
+
+            // Chunks currently allocated, each holding kChunkSize^2 tiles.
+            std::size_t GetChunkCount() const
+            {
+                return chunks_.size() - std::count(chunks_.begin(), chunks_.end(), nullptr);
+            }
+
+            bool CanBuild(const ForegroundCell &cell) const
+            {
+                CellPosition cellPosition = cell.GetTopLeftCellPosition();
+
+                if (cellPosition.col < 0 || cellPosition.col + cell.GetWidth() > TConfig::kBoardWidth ||
+                    cellPosition.row < 0 || cellPosition.row + cell.GetHeight() > TConfig::kBoardHeight)
+                {
+                    return false;
+                }
+
+                for (std::size_t i = 0; i < cell.GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < cell.GetWidth(); ++j)
+                    {
+                        if (!GetLayeredCell(cellPosition + CellPosition{static_cast<int>(i), static_cast<int>(j)}).CanBuild())
+                        {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+            template <typename TCell, typename... TArgs>
+            bool Build(CellPosition cellPosition, TArgs... args)
+            {
+                TCell cell(cellPosition, args...);
+                if (!CanBuild(cell))
+                    return false;
+
+                const CellPosition topLeft = cell.GetTopLeftCellPosition();
+
+                if constexpr (std::is_same<TCell, WallCell>::value)
+                {
+                    const int tile = ToTile(topLeft);
+                    walls_[tile / 64] |= std::uint64_t{1} << (tile % 64);
+                    if (Chunk *chunk = chunks_[ToChunkIndex(topLeft)].get())
+                    {
+                        chunk->views[ToLocalTile(topLeft)] = GetSharedView(tile);
+                    }
+                    distanceField_.template OnBuilt<TCell>(topLeft, *this);
+                    return true;
+                }
+
+                if constexpr (std::is_same<TCell, MiningMachineCell>::value)
+                {
+                    cell.ResolveMinedNumber(GetLayeredCell(topLeft));
+                }
+                const int owner = ToTile(topLeft);
+                TCell &stored = GetOrCreateChunk(topLeft).cells[ToLocalTile(topLeft)].template emplace<TCell>(cell);
+
+                for (std::size_t i = 0; i < stored.GetHeight(); ++i)
+                {
+                    for (std::size_t j = 0; j < stored.GetWidth(); ++j)
+                    {
+                        CellPosition position = topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)};
+                        Chunk &chunk = GetOrCreateChunk(position);
+                        chunk.owners[ToLocalTile(position)] = owner;
+                        chunk.views[ToLocalTile(position)].SetForegrund(ViewOf(stored));
+                        ++chunk.occupiedTiles;
+                        distanceField_.template OnBuilt<TCell>(position, *this);
+
+                        const int tile = ToTile(position);
+                        if (stored.TCell::IsUpdatable(position))
+                        {
+                            activeCells_.insert(FindActiveCell(tile), ActiveCell{tile, owner, position, &GetOwnerCell(owner)});
+                        }
+                    }
+                }
+                return true;
+            }
+
+            void Remove(CellPosition cellPosition)
+            {
+                const ForegroundCell *foreground = GetLayeredCell(cellPosition).GetForeground().get();
+
+                if (foreground == nullptr || !foreground->CanRemove())
+                    return;
+
+                const CellPosition topLeft = foreground->GetTopLeftCellPosition();
+                const std::size_t height = foreground->GetHeight();
+                const std::size_t width = foreground->GetWidth();
+
+                for (std::size_t i = 0; i < height; ++i)
+                {
+                    for (std::size_t j = 0; j < width; ++j)
+                    {
+                        const CellPosition position = topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)};
+                        const int tile = ToTile(position);
+                        Chunk &chunk = *chunks_[ToChunkIndex(position)];
+                        chunk.owners[ToLocalTile(position)] = -1;
+                        chunk.views[ToLocalTile(position)].SetForegrund(nullptr);
+                        --chunk.occupiedTiles;
+                        distanceField_.Open(position, *this);
+                        auto it = FindActiveCell(tile);
+                        if (it != activeCells_.end() && it->tile == tile)
+                        {
+                            activeCells_.erase(it);
+                        }
+                    }
+                }
+                chunks_[ToChunkIndex(topLeft)]->cells[ToLocalTile(topLeft)] = std::monostate{};
+
+                for (std::size_t i = 0; i < height; ++i)
+                {
+                    for (std::size_t j = 0; j < width; ++j)
+                    {
+                        std::unique_ptr<Chunk> &chunk =
+                            chunks_[ToChunkIndex(topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)})];
+                        if (chunk != nullptr && chunk->occupiedTiles == 0)
+                        {
+                            chunk = nullptr;
+                        }
+                    }
+                }
+            }
+
+            // Only NumberCell backgrounds (or none) can be stored in the byte grid.
+            void SetBackground(CellPosition cellPosition, std::shared_ptr<IBackgroundCell> value)
+            {
+                const auto numberCell = std::dynamic_pointer_cast<NumberCell>(value);
+                assert(value == nullptr || (numberCell != nullptr && numberCell->GetNumber() > 0 &&
+                                            numberCell->GetNumber() < static_cast<int>(palette_.size())));
+
+                const std::uint8_t number = numberCell != nullptr ? static_cast<std::uint8_t>(numberCell->GetNumber()) : 0;
+                if (number != 0 && palette_[number].GetBackground() == nullptr)
+                {
+                    palette_[number].SetBackground(numberCell);
+                    wallPalette_[number].SetBackground(numberCell);
+                }
+                backgrounds_[ToTile(cellPosition)] = number;
+
+                if (Chunk *chunk = chunks_[ToChunkIndex(cellPosition)].get())
+                {
+                    chunk->views[ToLocalTile(cellPosition)].SetBackground(palette_[number].GetBackground());
+                }
+            }
+
+            // See DistanceField::Get().
+            int GetDistanceToCollectionCenter(CellPosition cellPosition) const
+            {
+                return distanceField_.Get(cellPosition);
+            }
+
+            std::size_t GetCapacity(CellPosition cellPosition) const
+            {
+                const Chunk *chunk = chunks_[ToChunkIndex(cellPosition)].get();
+                const int owner = chunk != nullptr ? chunk->owners[ToLocalTile(cellPosition)] : -1;
+                if (owner < 0)
+                    return 0;
+
+                return std::visit([cellPosition](const auto &cell) { return GetCellCapacity(cell, cellPosition); },
+                                  GetOwnerCell(owner));
+            }
+
+            void ReceiveProduct(CellPosition cellPosition, int number)
+            {
+                Chunk *chunk = chunks_[ToChunkIndex(cellPosition)].get();
+                const int owner = chunk != nullptr ? chunk->owners[ToLocalTile(cellPosition)] : -1;
+                if (owner < 0)
+                    return;
+
+                std::visit([cellPosition, number](auto &cell) { ReceiveCellProduct(cell, cellPosition, number); },
+                           GetOwnerCell(owner));
+            }
+
+            void GetState(std::vector<int> &state) const
+            {
+                state.clear();
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    state.push_back(activeCell.tile);
+                    std::visit([&](const auto &cell) { AppendCellState(cell, activeCell.position, state); }, *activeCell.cell);
+                }
+            }
+
+            // Restores a GetState() of a board on which the same cells were built.
+            // Returns false if state does not fit the cells of this board; the
+            // cells before the mismatch are restored all the same.
+            bool SetState(const std::vector<int> &state)
+            {
+                std::vector<int> expected;
+                const int *it = state.data();
+                const int *end = it + state.size();
+                while (it != end)
+                {
+                    const int tile = *it++;
+                    auto activeCell = FindActiveCell(tile);
+                    if (activeCell == activeCells_.end() || activeCell->tile != tile)
+                        return false;
+
+                    CellVariant &cell = *activeCell->cell;
+                    const CellPosition position = activeCell->position;
+                    expected.clear();
+                    std::visit([&](const auto &value) { AppendCellState(value, position, expected); }, cell);
+                    if (end - it < static_cast<std::ptrdiff_t>(expected.size()))
+                        return false;
+
+                    it = std::visit([&](auto &value) { return ReadCellState(value, position, it); }, cell);
+                    if (it == nullptr)
+                        return false;
+                }
+                return true;
+            }
+
+            // The board keeps no clock: GetStateHash() follows from GetState().
+            void GetClock(std::vector<int> &clock) const
+            {
+                clock.clear();
+            }
+
+            bool SetClock(const std::vector<int> &)
+            {
+                return true;
+            }
+
+            // Not maintained incrementally: hashes GetState(), O(active tiles).
+            std::uint64_t GetStateHash() const
+            {
+                std::vector<int> state;
+                GetState(state);
+                return HashState(state);
+            }
+
+            void Update()
+            {
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    std::visit([&](auto &cell) { RunPassOne(cell, activeCell.position); }, *activeCell.cell);
+                }
+                for (const ActiveCell &activeCell : activeCells_)
+                {
+                    std::visit([&](auto &cell) { RunPassTwo(cell, activeCell.position); }, *activeCell.cell);
+                }
+            }
+
+        private:
+            struct Chunk
+            {
+                Chunk() : cells{}, owners{}, views{}, occupiedTiles{}
+                {
+                    owners.fill(-1);
+                }
+
+                std::array<CellVariant, kChunkSize * kChunkSize> cells;
+                // Board tile of the cell covering each tile, or -1.
+                std::array<int, kChunkSize * kChunkSize> owners;
+                std::array<LayeredCell, kChunkSize * kChunkSize> views;
+                int occupiedTiles;
+            };
+
+            struct ActiveCell
+            {
+                int tile;
+                int owner;
+                CellPosition position;
+                CellVariant *cell;
+            };
+
+            static int ToTile(CellPosition cellPosition)
+            {
+                return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+            }
+
+            typename std::vector<ActiveCell>::iterator FindActiveCell(int tile)
+            {
+                return std::lower_bound(
+                    activeCells_.begin(), activeCells_.end(), tile,
+                    [](const ActiveCell &activeCell, int value) { return activeCell.tile < value; });
+            }
+
+            static int ToChunkIndex(CellPosition cellPosition)
+            {
+                return cellPosition.row / kChunkSize * kChunkCols + cellPosition.col / kChunkSize;
+            }
+
+            static int ToLocalTile(CellPosition cellPosition)
+            {
+                return cellPosition.row % kChunkSize * kChunkSize + cellPosition.col % kChunkSize;
+            }
+
+            static CellPosition ToPosition(int tile)
+            {
+                return {tile / TConfig::kBoardWidth, tile % TConfig::kBoardWidth};
+            }
+
+            CellVariant &GetOwnerCell(int owner)
+            {
+                const CellPosition position = ToPosition(owner);
+                return chunks_[ToChunkIndex(position)]->cells[ToLocalTile(position)];
+            }
+
+            const CellVariant &GetOwnerCell(int owner) const
+            {
+                const CellPosition position = ToPosition(owner);
+                return chunks_[ToChunkIndex(position)]->cells[ToLocalTile(position)];
+            }
+
+            // The view of a tile without a chunk: its background, and its wall
+            // if it has one.
+            const LayeredCell &GetSharedView(int tile) const
+            {
+                const bool wall = (walls_[tile / 64] >> (tile % 64)) & 1;
+                return wall ? wallPalette_[backgrounds_[tile]] : palette_[backgrounds_[tile]];
+            }
+
+            Chunk &GetOrCreateChunk(CellPosition cellPosition)
+            {
+                std::unique_ptr<Chunk> &chunk = chunks_[ToChunkIndex(cellPosition)];
+                if (chunk == nullptr)
+                {
+                    chunk = std::make_unique<Chunk>();
+                    const CellPosition origin{cellPosition.row / kChunkSize * kChunkSize,
+                                              cellPosition.col / kChunkSize * kChunkSize};
+                    for (int i = 0; i < kChunkSize; ++i)
+                    {
+                        for (int j = 0; j < kChunkSize; ++j)
+                        {
+                            const CellPosition position = origin + CellPosition{i, j};
+                            if (IsWithinBoard(position))
+                            {
+                                chunk->views[ToLocalTile(position)] = GetSharedView(ToTile(position));
+                            }
+                        }
+                    }
+                }
+                return *chunk;
+            }
+
+            // A non-owning pointer to a cell stored in a chunk.
+            static std::shared_ptr<ForegroundCell> ViewOf(CellVariant &cell)
+            {
+                return std::visit(
+                    [](auto &value) -> std::shared_ptr<ForegroundCell> {
+                        using TCell = std::decay_t<decltype(value)>;
+                        if constexpr (std::is_same<TCell, std::monostate>::value)
+                            return nullptr;
+                        else
+                            return std::shared_ptr<ForegroundCell>(std::shared_ptr<ForegroundCell>(), &value);
+                    },
+                    cell);
+            }
+
+            template <typename TCell>
+            static std::shared_ptr<ForegroundCell> ViewOf(TCell &cell)
+            {
+                return std::shared_ptr<ForegroundCell>(std::shared_ptr<ForegroundCell>(), &cell);
+            }
+
+            // Qualified calls (cell.TCell::...) bypass the vtable.
+            template <typename TCell>
+            static std::size_t GetCellCapacity(const TCell &cell, CellPosition cellPosition)
+            {
+                return cell.TCell::GetCapacity(cellPosition);
+            }
+
+            static std::size_t GetCellCapacity(const std::monostate &, CellPosition)
+            {
+                return 0;
+            }
+
+            template <typename TCell>
+            static void ReceiveCellProduct(TCell &cell, CellPosition cellPosition, int number)
+            {
+                cell.TCell::ReceiveProduct(cellPosition, number);
+            }
 
-        std::shared_ptr<IBackgroundCell> Create()
-        {
-            int val = gen_() % 30;
+            static void ReceiveCellProduct(std::monostate &, CellPosition, int)
+            {
+            }
 
-            std::set<int> numbers = {1, 2, 3, 5, 7, 11};
+            template <typename TCell>
+            static void AppendCellState(const TCell &cell, CellPosition cellPosition, std::vector<int> &state)
+            {
+                cell.TCell::AppendState(cellPosition, state);
+            }
 
-            if (numbers.count(val))
+            static void AppendCellState(const std::monostate &, CellPosition, std::vector<int> &)
             {
-                return std::make_shared<NumberCell>(val);
             }
-            else
+
+            template <typename TCell>
+            static const int *ReadCellState(TCell &cell, CellPosition cellPosition, const int *state)
             {
-                return nullptr;
+                return cell.TCell::ReadState(cellPosition, state);
             }
-        }
 
-    private:
-        std::mt19937 gen_;
-    };
+            static const int *ReadCellState(std::monostate &, CellPosition, const int *state)
+            {
+                return state;
+            }
 
-    class MiningMachineCell : public ForegroundCell
-    {
-    public:
-        MiningMachineCell(CellPosition topLeft, Direction direction)
-            : ForegroundCell(topLeft), direction_{direction}, elapsedTime_{0} {}
+            template <typename TCell>
+            void RunPassOne(TCell &cell, CellPosition cellPosition)
+            {
+                if constexpr (std::is_same<TCell, ConveyorCell>::value || std::is_same<TCell, CombinerCell>::value ||
+                              std::is_same<TCell, MiningMachineCell>::value)
+                {
+                    cell.RunPassOne(cellPosition, *this);
+                }
+            }
 
-        Direction GetDirection() const { return direction_; }
+            template <typename TCell>
+            void RunPassTwo(TCell &cell, CellPosition cellPosition)
+            {
+                if constexpr (std::is_same<TCell, ConveyorCell>::value)
+                {
+                    cell.RunPassTwo(cellPosition, *this);
+                }
+            }
 
-        void Accept(const CellVisitor *visitor) const override
-        {
-            visitor->Visit(this);
-        }
+            std::vector<std::unique_ptr<Chunk>> chunks_;
+            std::vector<std::uint8_t> backgrounds_;
+            // One bit per tile that has a wall.
+            std::vector<std::uint64_t> walls_;
+            // The view of a tile without a chunk, by background number, with
+            // and without a wall.
+            std::array<LayeredCell, 256> palette_;
+            std::array<LayeredCell, 256> wallPalette_;
+            std::vector<ActiveCell> activeCells_;
+            // Dense, unlike the cells; see DistanceField.
+            DistanceField distanceField_;
+        };
 
-        bool CanRemove() const override
-        {
-            return true;
-        }
-        std::size_t GetCapacity(CellPosition cellPosition) const override
-        {
-            return 0;
-        }
-        void ReceiveProduct(CellPosition cellPosition, int number) override
+        class IGamePlayer
         {
-        }
-        void UpdatePassOne(CellPosition cellPosition, GameBoard &board) override
+        public:
+            virtual PlayerAction GetNextAction(const IGameInfo& info) = 0;
+
+            // Returning true promises that every later GetNextAction() would
+            // return PlayerActionType::None, which allows fast-forwarding.
+            virtual bool IsFinished() const { return false; }
+        };
+
+        template <typename TGameBoard>
+        class BasicGameManager : public IGameManager
         {
-            ++elapsedTime_;
-            if (elapsedTime_ >= 100)
+        public:
+            struct CollectionCenterConfig
+            {
+                static constexpr int kLeft = TConfig::kBoardWidth / 2 - TConfig::kGoalSize / 2;
+                static constexpr int kTop = TConfig::kBoardHeight / 2 - TConfig::kGoalSize / 2;
+            };
+
+            BasicGameManager(
+                IGamePlayer* player,
+                int commonDividor, 
+                unsigned int seed,
+                CellAllocation allocation = CellAllocation::kHeap) 
+                : elapsedTime_{}, endTime_{TConfig::kEndTime}, player_(player),
+                  arena_(allocation == CellAllocation::kArena ? std::make_shared<CellArena>() : nullptr), board_(),
+                  commonDividor_{commonDividor}, seed_{seed}, scores_{}, fastForward_{}, profile_{}, numberCells_{}
+            {
+                static_assert(TConfig::kBoardWidth % 2 == 0, "WIDTH must be even");
+
+                board_.SetArena(arena_.get());
+                board_.SetProfile(&profile_);
+                Initialize(seed);
+            }
+
+            // A plain copy would share cells with the original; use Fork().
+            BasicGameManager(const BasicGameManager &) = delete;
+            BasicGameManager &operator=(const BasicGameManager &) = delete;
+
+            // Returns an independent snapshot of this game that can be advanced
+            // privately, e.g. to evaluate an action before playing it. Backgrounds
+            // and stateless cells stay shared with this game; the others are
+            // copied. The fork asks player for its actions, or plays none if
+            // player is null.
+            std::unique_ptr<BasicGameManager> Fork(IGamePlayer* player = nullptr) const
             {
-                auto numberCell =
-                    dynamic_cast<const NumberCell *>(board.GetLayeredCell(cellPosition).GetBackground().get());
+                return std::unique_ptr<BasicGameManager>(new BasicGameManager(*this, player));
+            }
 
-                if (numberCell && GetNeighborCapacity(board, cellPosition, direction_) >= 3)
+            // Starts a new game on this manager. With CellAllocation::kArena the
+            // cells of the previous game are released and their memory reused.
+            void Reset(IGamePlayer* player, int commonDividor, unsigned int seed)
+            {
+                board_.Clear();
+                if (arena_ != nullptr)
                 {
-                    SendProduct(board, cellPosition, direction_, numberCell->GetNumber());
+                    // A copied manager may still hold cells of the previous game.
+                    if (arena_.use_count() > 1)
+                        arena_ = std::make_shared<CellArena>();
+                    else
+                        arena_->Reset();
+                    board_.SetArena(arena_.get());
                 }
 
                 elapsedTime_ = 0;
+                player_ = player;
+                commonDividor_ = commonDividor;
+                seed_ = seed;
+                scores_ = 0;
+                profile_ = EngineProfile();
+                Initialize(seed);
             }
-        }
-    private:
-        Direction direction_;
-        std::size_t elapsedTime_;
-    };
-
-    enum class PlayerActionType
-    {
-        None,
-        BuildLeftOutMiningMachine,
-        BuildTopOutMiningMachine,
-        BuildRightOutMiningMachine,
-        BuildBottomOutMiningMachine,
-        BuildLeftToRightConveyor,
-        BuildTopToBottomConveyor,
-        BuildRightToLeftConveyor,
-        BuildBottomToTopConveyor,
-        BuildTopOutCombiner,
-        BuildRightOutCombiner,
-        BuildBottomOutCombiner,
-        BuildLeftOutCombiner,
-        Clear,
-    };
 
-    struct PlayerAction
-    {
-        PlayerActionType type;
-        CellPosition cellPosition;
-    };
+            bool IsGameOver() const override
+            {
+                return elapsedTime_ >= endTime_;
+            }
 
-    class IGamePlayer
-    {
-    public:
-        virtual PlayerAction GetNextAction(const IGameInfo& info) = 0;
-    };
+            int GetEndTime() const override { return endTime_; }
 
-    class GameManager : public IGameManager
-    {
-    public:
-        struct CollectionCenterConfig
-        {
-            static constexpr int kLeft = GameManagerConfig::kBoardWidth / 2 - GameManagerConfig::kGoalSize / 2;
-            static constexpr int kTop = GameManagerConfig::kBoardHeight / 2 - GameManagerConfig::kGoalSize / 2;
-        };
+            int GetElapsedTime() const override { return elapsedTime_; }
 
-        GameManager(
-            IGamePlayer* player,
-            int commonDividor, 
-            unsigned int seed) 
-            : elapsedTime_{}, endTime_{GameManagerConfig::kEndTime}, player_(player), board_(), commonDividor_{commonDividor}, scores_{}
-        {
-            static_assert(GameManagerConfig::kBoardWidth % 2 == 0, "WIDTH must be even");
+            std::string GetLevelInfo() const override
+            {
+                return "(" + std::to_string(commonDividor_) + ")";
+            }
 
-            BackgroundCellFactory backgroundCellFactory(seed);
+            bool IsScoredProduct(int number) const override
+            {
+                return number % commonDividor_ == 0;
+            }
 
-            for (int row = 0; row < GameManagerConfig::kBoardHeight; ++row)
+            void OnProductReceived(int number) override
             {
-                for (int col = 0; col < GameManagerConfig::kBoardWidth; ++col)
-                {
-                    auto backgroundCell = backgroundCellFactory.Create();
+                assert(number != 0);
 
-                    board_.SetBackground({row, col}, backgroundCell);
+                if (number % commonDividor_ == 0)
+                {
+                    AddScore();
                 }
-            };
-
-            auto collectionCenterTopLeftCellPosition =
-                CellPosition{CollectionCenterConfig::kTop, CollectionCenterConfig::kLeft};
+            }
 
-            board_.template Build<CollectionCenterCell>(collectionCenterTopLeftCellPosition, this);
+            int GetScores() const override
+            {
+                return scores_;
+            }
 
-            std::mt19937 gen(seed);
+            const LayeredCell &GetLayeredCell(CellPosition cellPosition) const override
+            {
+                return board_.GetLayeredCell(cellPosition);
+            }
 
-            for (int k = 1; k <= GameManagerConfig::kNumberOfWalls; ++k)
+            std::uint64_t GetStateHash() const override
             {
-                std::uniform_int_distribution<int> disRow(0, GameManagerConfig::kBoardHeight - 1);
-                std::uniform_int_distribution<int> disCol(0, GameManagerConfig::kBoardWidth - 1);
-                CellPosition cellPosition;
-                cellPosition.row = disRow(gen);
-                cellPosition.col = disCol(gen);
-                if (board_.GetLayeredCell(cellPosition).GetForeground() == nullptr)
-                {
-                    board_.template Build<WallCell>(cellPosition);
-                }
+                return board_.GetStateHash();
             }
-        }
 
-        bool IsGameOver() const override
-        {
-            return elapsedTime_ >= endTime_;
-        }
+            int GetDistanceToCollectionCenter(CellPosition cellPosition) const override
+            {
+                return board_.GetDistanceToCollectionCenter(cellPosition);
+            }
 
-        int GetEndTime() const override { return endTime_; }
+            const NumberCellIndex &GetNumberCellIndex() const override
+            {
+                return numberCells_;
+            }
 
-        int GetElapsedTime() const override { return elapsedTime_; }
+            void AddScore()
+            {
+                scores_++;
+            }
 
-        std::string GetLevelInfo() const override
-        {
-            return "(" + std::to_string(commonDividor_) + ")";
-        }
+            void SetSchedulingMode(SchedulingMode mode)
+            {
+                board_.SetSchedulingMode(mode);
+            }
 
-        bool IsScoredProduct(int number) const override
-        {
-            return number % commonDividor_ == 0;
-        }
+            // Threads for SchedulingMode::kParallel; see GameBoard::SetThreadCount().
+            void SetThreadCount(std::size_t threadCount)
+            {
+                board_.SetThreadCount(threadCount);
+            }
 
-        void OnProductReceived(int number) override
-        {
-            assert(number != 0);
+            // Bytes reserved by the cell arena, or 0 for heap allocation.
+            std::size_t GetArenaReservedBytes() const
+            {
+                return arena_ != nullptr ? arena_->GetReservedBytes() : 0;
+            }
 
-            if (number % commonDividor_ == 0)
+            // When enabled, Update() jumps to the end of the game as soon as the
+            // player reports IsFinished(); see FastForwardToEnd().
+            void SetFastForward(bool enabled)
             {
-                AddScore();
+                fastForward_ = enabled;
             }
-        }
 
-        int GetScores() const override
-        {
-            return scores_;
-        }
+            // Runs the rest of the game without consulting the player. Once the
+            // board state repeats, the score gained over one period is verified
+            // by simulating the period once more, and the remaining whole periods
+            // are added in closed form. The final scores are exactly those of a
+            // tick-by-tick simulation in which the player does nothing.
+            void FastForwardToEnd()
+            {
+                std::unordered_map<std::uint64_t, std::size_t> seenTimes;
+                std::vector<int> state;
+                std::vector<int> cycleStartState;
 
-        const LayeredCell &GetLayeredCell(CellPosition cellPosition) const override
-        {
-            return board_.GetLayeredCell(cellPosition);
-        }
+                while (elapsedTime_ < endTime_)
+                {
+                    const std::uint64_t hash = board_.GetStateHash();
 
-        void AddScore()
-        {
-            scores_++;
-        }
+                    auto it = seenTimes.find(hash);
+                    if (it == seenTimes.end())
+                    {
+                        seenTimes.emplace(hash, elapsedTime_);
+                        UpdateBoard();
+                        continue;
+                    }
 
-        void Update()
-        {
-            if (elapsedTime_ >= endTime_) return;
+                    const std::size_t period = elapsedTime_ - it->second;
+                    it->second = elapsedTime_;
+                    if (elapsedTime_ + 2 * period > endTime_)
+                        break;
 
-            ++elapsedTime_;
-            
-            if (elapsedTime_ % 3 == 0) 
+                    const int cycleStartScores = scores_;
+                    board_.GetState(cycleStartState);
+                    for (std::size_t k = 0; k < period; ++k)
+                    {
+                        UpdateBoard();
+                    }
+
+                    board_.GetState(state);
+                    if (state == cycleStartState)
+                    {
+                        const std::size_t cycles = (endTime_ - elapsedTime_) / period;
+                        scores_ += static_cast<int>(cycles) * (scores_ - cycleStartScores);
+                        elapsedTime_ += cycles * period;
+                        break;
+                    }
+                }
+
+                while (elapsedTime_ < endTime_)
+                {
+                    UpdateBoard();
+                }
+            }
+
+            // Carries out one player action immediately, as Update() does with
+            // the player's choice every third tick.
+            void ApplyAction(const PlayerAction &playerAction)
             {
-                PlayerAction playerAction = player_->GetNextAction(*this);
+                if (playerAction.type == PlayerActionType::Clear)
+                {
+                    // The cell's tiles have to be read before it is gone.
+                    const ForegroundCell *foreground = board_.GetLayeredCell(playerAction.cellPosition).GetForeground().get();
+                    if (foreground == nullptr)
+                        return;
+
+                    const CellPosition topLeft = foreground->GetTopLeftCellPosition();
+                    const std::size_t height = foreground->GetHeight();
+                    const std::size_t width = foreground->GetWidth();
+                    board_.Remove(playerAction.cellPosition);
+                    RefreshNumberCells(topLeft, height, width);
+                    return;
+                }
 
                 switch (playerAction.type)
                 {
                 case PlayerActionType::None:
-                    break;
+                case PlayerActionType::Clear:
+                    return;
                 case PlayerActionType::BuildLeftOutMiningMachine:
                     board_.template Build<MiningMachineCell>(playerAction.cellPosition, Direction::kLeft);
                     break;
@@ -867,27 +4651,325 @@ namespace Feis
                 case PlayerActionType::BuildLeftOutCombiner:
                     board_.template Build<CombinerCell>(playerAction.cellPosition, Direction::kLeft);
                     break;
-                case PlayerActionType::Clear:
-                    board_.Remove(playerAction.cellPosition);
-                    break;
+                }
+
+                if (const ForegroundCell *foreground = board_.GetLayeredCell(playerAction.cellPosition).GetForeground().get())
+                {
+                    RefreshNumberCells(foreground->GetTopLeftCellPosition(), foreground->GetHeight(), foreground->GetWidth());
                 }
             }
 
-            board_.Update();
-        }
+            // Replaces checkpoint with a snapshot from which LoadCheckpoint() can
+            // resume this game: the time, the scores, the actions that rebuild the
+            // player's cells, the board clock and the board state. Walls and
+            // backgrounds are not stored; they follow from the seed.
+            void SaveCheckpoint(std::vector<int> &checkpoint)
+            {
+                checkpoint.assign({static_cast<int>(elapsedTime_), scores_, 0});
 
-    private:
-        std::size_t elapsedTime_;
-        std::size_t endTime_;
-        IGamePlayer* player_;
-        GameBoard board_;
-        int commonDividor_;
-        int scores_;
+                for (int row = 0; row < TConfig::kBoardHeight; ++row)
+                {
+                    for (int col = 0; col < TConfig::kBoardWidth; ++col)
+                    {
+                        const auto &foreground = board_.GetLayeredCell({row, col}).GetForeground();
+                        if (foreground == nullptr || !foreground->CanRemove() ||
+                            !(foreground->GetTopLeftCellPosition() == CellPosition{row, col}))
+                            continue;
+
+                        PlayerActionType type = PlayerActionType::None;
+                        BuildActionVisitor visitor(&type);
+                        foreground->Accept(&visitor);
+                        checkpoint.insert(checkpoint.end(), {static_cast<int>(type), row, col});
+                        ++checkpoint[2];
+                    }
+                }
+
+                std::vector<int> clock;
+                board_.GetClock(clock);
+                checkpoint.push_back(static_cast<int>(clock.size()));
+                checkpoint.insert(checkpoint.end(), clock.begin(), clock.end());
+
+                std::vector<int> state;
+                board_.GetState(state);
+                checkpoint.insert(checkpoint.end(), state.begin(), state.end());
+            }
+
+            // Resumes a game from a SaveCheckpoint() of a game with the same
+            // level and seed. The player is kept. Returns false, with the game
+            // back at its start, if checkpoint is not such a snapshot.
+            bool LoadCheckpoint(const std::vector<int> &checkpoint)
+            {
+                Reset(player_, commonDividor_, seed_);
+                if (RestoreCheckpoint(checkpoint))
+                    return true;
+
+                Reset(player_, commonDividor_, seed_);
+                return false;
+            }
+
+            // Engine counters of this game; all zero unless compiled with
+            // PDOGS_PROFILE.
+            const EngineProfile &GetProfile() const
+            {
+                return profile_;
+            }
+
+            void DumpProfile(std::ostream &out) const
+            {
+                profile_.Dump(out);
+            }
+
+            void Update()
+            {
+#ifdef PDOGS_PROFILE
+                const std::size_t startTime = elapsedTime_;
+                const auto start = std::chrono::steady_clock::now();
+                RunTick();
+                profile_.ticks += elapsedTime_ - startTime;
+                profile_.updateNanoseconds +=
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#else
+                RunTick();
+#endif
+            }
+
+        private:
+            void RunTick()
+            {
+                if (elapsedTime_ >= endTime_) return;
+
+                if (fastForward_ && (player_ == nullptr || player_->IsFinished()))
+                {
+                    FastForwardToEnd();
+                    return;
+                }
+
+                ++elapsedTime_;
+            
+                if (elapsedTime_ % 3 == 0) 
+                {
+                    PlayerAction playerAction{PlayerActionType::None, {}};
+                    if (player_ != nullptr)
+                    {
+                        ProfileTimer timer(&profile_.player);
+                        playerAction = player_->GetNextAction(*this);
+                    }
+                    ApplyAction(playerAction);
+                }
+
+                ProfileTimer timer(&profile_.boardUpdate);
+                board_.Update();
+            }
+
+            bool RestoreCheckpoint(const std::vector<int> &checkpoint)
+            {
+                if (checkpoint.size() < 3 || checkpoint[0] < 0 || checkpoint[0] > GetEndTime() || checkpoint[1] < 0 ||
+                    checkpoint[2] < 0 || static_cast<std::size_t>(checkpoint[2]) > (checkpoint.size() - 3) / 3)
+                    return false;
+
+                const int cellCount = checkpoint[2];
+                for (int i = 0; i < cellCount; ++i)
+                {
+                    const int *action = &checkpoint[3 + 3 * i];
+                    const PlayerAction playerAction{static_cast<PlayerActionType>(action[0]), {action[1], action[2]}};
+                    if (action[0] <= static_cast<int>(PlayerActionType::None) ||
+                        action[0] >= static_cast<int>(PlayerActionType::Clear) || !IsWithinBoard(playerAction.cellPosition))
+                        return false;
+
+                    // The action must build exactly that cell at that tile.
+                    ApplyAction(playerAction);
+                    const ForegroundCell *built = board_.GetLayeredCell(playerAction.cellPosition).GetForeground().get();
+                    PlayerActionType type = PlayerActionType::None;
+                    BuildActionVisitor visitor(&type);
+                    if (built != nullptr)
+                    {
+                        built->Accept(&visitor);
+                    }
+                    if (type != playerAction.type || !(built->GetTopLeftCellPosition() == playerAction.cellPosition))
+                        return false;
+                }
+
+                const std::size_t clockStart = 3 + 3 * static_cast<std::size_t>(cellCount) + 1;
+                if (clockStart > checkpoint.size() || checkpoint[clockStart - 1] < 0 ||
+                    static_cast<std::size_t>(checkpoint[clockStart - 1]) > checkpoint.size() - clockStart)
+                    return false;
+
+                const std::size_t stateStart = clockStart + checkpoint[clockStart - 1];
+                if (!board_.SetClock(std::vector<int>(checkpoint.begin() + clockStart, checkpoint.begin() + stateStart)) ||
+                    !board_.SetState(std::vector<int>(checkpoint.begin() + stateStart, checkpoint.end())))
+                    return false;
+
+                elapsedTime_ = checkpoint[0];
+                scores_ = checkpoint[1];
+                return true;
+            }
+
+            // The action that builds the visited cell.
+            class BuildActionVisitor : public CellVisitor
+            {
+            public:
+                BuildActionVisitor(PlayerActionType *type) : type_(type) {}
+
+                void Visit(const MiningMachineCell *cell) const override
+                {
+                    static constexpr PlayerActionType kTypes[] = {
+                        PlayerActionType::BuildTopOutMiningMachine, PlayerActionType::BuildRightOutMiningMachine,
+                        PlayerActionType::BuildBottomOutMiningMachine, PlayerActionType::BuildLeftOutMiningMachine};
+                    *type_ = kTypes[static_cast<int>(cell->GetDirection())];
+                }
+
+                void Visit(const ConveyorCell *cell) const override
+                {
+                    static constexpr PlayerActionType kTypes[] = {
+                        PlayerActionType::BuildBottomToTopConveyor, PlayerActionType::BuildLeftToRightConveyor,
+                        PlayerActionType::BuildTopToBottomConveyor, PlayerActionType::BuildRightToLeftConveyor};
+                    *type_ = kTypes[static_cast<int>(cell->GetDirection())];
+                }
+
+                void Visit(const CombinerCell *cell) const override
+                {
+                    static constexpr PlayerActionType kTypes[] = {
+                        PlayerActionType::BuildTopOutCombiner, PlayerActionType::BuildRightOutCombiner,
+                        PlayerActionType::BuildBottomOutCombiner, PlayerActionType::BuildLeftOutCombiner};
+                    *type_ = kTypes[static_cast<int>(cell->GetDirection())];
+                }
+
+            private:
+                PlayerActionType *type_;
+            };
+
+            BasicGameManager(const BasicGameManager &source, IGamePlayer* player)
+                : elapsedTime_{source.elapsedTime_}, endTime_{source.endTime_}, player_(player),
+                  arena_(source.arena_), board_(), commonDividor_{source.commonDividor_}, seed_{source.seed_},
+                  scores_{source.scores_},
+                  fastForward_{source.fastForward_}, profile_{}, numberCells_{source.numberCells_}
+            {
+                // arena_ only keeps the shared cells alive; the fork's own cells
+                // live on the heap so that forks never share an allocator.
+                board_.ForkFrom(source.board_, this);
+                board_.SetProfile(&profile_);
+            }
+
+            void Initialize(unsigned int seed)
+            {
+                BackgroundCellFactory backgroundCellFactory(seed, arena_.get());
+                numberCells_.Clear();
+
+                for (int row = 0; row < TConfig::kBoardHeight; ++row)
+                {
+                    for (int col = 0; col < TConfig::kBoardWidth; ++col)
+                    {
+                        auto backgroundCell = backgroundCellFactory.Create();
+
+                        board_.SetBackground({row, col}, backgroundCell);
+                        if (auto numberCell = std::dynamic_pointer_cast<NumberCell>(backgroundCell))
+                        {
+                            numberCells_.Add({row, col}, numberCell->GetNumber());
+                        }
+                    }
+                };
+
+                auto collectionCenterTopLeftCellPosition =
+                    CellPosition{CollectionCenterConfig::kTop, CollectionCenterConfig::kLeft};
+
+                board_.template Build<CollectionCenterCell>(collectionCenterTopLeftCellPosition, this);
+
+                std::mt19937 gen(seed);
+
+                for (int k = 1; k <= TConfig::kNumberOfWalls; ++k)
+                {
+                    std::uniform_int_distribution<int> disRow(0, TConfig::kBoardHeight - 1);
+                    std::uniform_int_distribution<int> disCol(0, TConfig::kBoardWidth - 1);
+                    CellPosition cellPosition;
+                    cellPosition.row = disRow(gen);
+                    cellPosition.col = disCol(gen);
+                    if (board_.GetLayeredCell(cellPosition).GetForeground() == nullptr)
+                    {
+                        board_.template Build<WallCell>(cellPosition);
+                    }
+                }
+
+                for (const auto &entry : numberCells_.GetEntries())
+                {
+                    numberCells_.SetBuildable(entry.position, board_.GetLayeredCell(entry.position).CanBuild());
+                }
+            }
+
+            // Updates the buildable flags of the NumberCells in a rectangle of
+            // tiles after a cell was built or removed there.
+            void RefreshNumberCells(CellPosition topLeft, std::size_t height, std::size_t width)
+            {
+                for (std::size_t i = 0; i < height; ++i)
+                {
+                    for (std::size_t j = 0; j < width; ++j)
+                    {
+                        const CellPosition position = topLeft + CellPosition{static_cast<int>(i), static_cast<int>(j)};
+                        numberCells_.SetBuildable(position, board_.GetLayeredCell(position).CanBuild());
+                    }
+                }
+            }
+
+            void UpdateBoard()
+            {
+                ++elapsedTime_;
+                board_.Update();
+            }
+
+            std::size_t elapsedTime_;
+            std::size_t endTime_;
+            IGamePlayer* player_;
+            // Declared before board_ so the cells are destroyed first.
+            std::shared_ptr<CellArena> arena_;
+            TGameBoard board_;
+            int commonDividor_;
+            unsigned int seed_;
+            int scores_;
+            bool fastForward_;
+            EngineProfile profile_;
+            NumberCellIndex numberCells_;
+        };
+
+        using GameManager = BasicGameManager<GameBoard>;
     };
+
+    using Engine = BasicEngine<GameManagerConfig>;
+
+    using IGameInfo = Engine::IGameInfo;
+    using IGameManager = Engine::IGameManager;
+    using CellVisitor = Engine::CellVisitor;
+    using Cell = Engine::Cell;
+    using IBackgroundCell = Engine::IBackgroundCell;
+    using ForegroundCell = Engine::ForegroundCell;
+    using ICellRenderer = Engine::ICellRenderer;
+    using ConveyorBuffer = Engine::ConveyorBuffer;
+    using ConveyorCell = Engine::ConveyorCell;
+    using CombinerCell = Engine::CombinerCell;
+    using WallCell = Engine::WallCell;
+    using CollectionCenterCell = Engine::CollectionCenterCell;
+    using LayeredCell = Engine::LayeredCell;
+    using DistanceField = Engine::DistanceField;
+    using GameBoard = Engine::GameBoard;
+    using NumberCell = Engine::NumberCell;
+    using NumberCellIndex = Engine::NumberCellIndex;
+    using BackgroundCellFactory = Engine::BackgroundCellFactory;
+    using MiningMachineCell = Engine::MiningMachineCell;
+    using FlatGameBoard = Engine::FlatGameBoard;
+    using VariantGameBoard = Engine::VariantGameBoard;
+    using ChunkedGameBoard = Engine::ChunkedGameBoard;
+    using IGamePlayer = Engine::IGamePlayer;
+    using GameManager = Engine::GameManager;
+
+    template <typename TGameBoard>
+    using BasicGameManager = Engine::BasicGameManager<TGameBoard>;
+
+    inline bool IsWithinBoard(CellPosition cellPosition)
+    {
+        return Engine::IsWithinBoard(cellPosition);
+    }
 }
 #endif
 
-#ifndef USE_GUI
+#if !defined(USE_GUI) && !defined(USE_ENGINE_ONLY)
 void Test(int commonDividor, unsigned int seed);
 
 void Test1A() { Test(1, 20); }
@@ -1129,6 +5211,9 @@ void Test(int commonDividor, unsigned int seed)
     }
     
     std::cout << gameManager.GetScores() << std::endl;
+#ifdef PDOGS_PROFILE
+    gameManager.DumpProfile(std::cerr);
+#endif
 }
 
 
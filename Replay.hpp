@@ -0,0 +1,223 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+#include "PDOGS.cpp"
+
+#include "ActionLog.hpp"
+
+// Random access into a recorded game. The game is simulated from its action
+// log, and a checkpoint (GameManager::SaveCheckpoint() plus the position in
+// the log) is kept every interval ticks as the simulation passes it. Seek()
+// restores the nearest checkpoint at or before the target tick and simulates
+// the rest, so it costs at most interval ticks once the checkpoints exist.
+//
+// The checkpoints can be written next to the log and loaded again; layout
+// (little endian):
+//   header       "PDCK", u32 version, i32 common divisor, u32 seed,
+//                u32 log size, u64 log hash, u32 interval, u32 count,
+//                u64 checkpoints hash
+//   checkpoints  u32 log offset, i32 log tick, u32 length, i32 x length
+// The level, seed, size and hash of the log tie the file to the log it was
+// built from; the hashes are FNV-1a of the bytes.
+class ReplayEngine
+{
+public:
+    static constexpr int kDefaultInterval = 500;
+
+    // log must outlive the engine.
+    explicit ReplayEngine(const ActionLogReader &log, int interval = kDefaultInterval)
+        : log_(log), interval_(interval), player_(log), game_(&player_, log.GetHeader().commonDivisor, log.GetHeader().seed)
+    {
+        AddCheckpoint();
+    }
+
+    ReplayEngine(const ReplayEngine &) = delete;
+    ReplayEngine &operator=(const ReplayEngine &) = delete;
+
+    // The game after GetElapsedTime() ticks.
+    const Feis::GameManager &GetGame() const
+    {
+        return game_;
+    }
+
+    int GetCheckpointInterval() const
+    {
+        return interval_;
+    }
+
+    std::size_t GetCheckpointCount() const
+    {
+        return checkpoints_.size();
+    }
+
+    // Brings the game to the given tick, clamped to [0, end time].
+    const Feis::GameManager &Seek(int tick)
+    {
+        tick = std::max(0, std::min(tick, game_.GetEndTime()));
+
+        const int nearest = std::min(tick / interval_, static_cast<int>(checkpoints_.size()) - 1);
+        const int current = game_.GetElapsedTime();
+        if (current > tick || nearest * interval_ > current)
+        {
+            const Checkpoint &checkpoint = checkpoints_[nearest];
+            ActionLogReader reader = log_;
+            reader.SetPosition(checkpoint.position);
+            player_ = ActionLogPlayer(reader);
+            // LoadCheckpoints() only accepts checkpoints that load.
+            const bool loaded = game_.LoadCheckpoint(checkpoint.game);
+            assert(loaded);
+            (void)loaded;
+        }
+
+        while (game_.GetElapsedTime() < tick)
+        {
+            game_.Update();
+            if (game_.GetElapsedTime() == static_cast<int>(checkpoints_.size()) * interval_)
+            {
+                AddCheckpoint();
+            }
+        }
+        return game_;
+    }
+
+    // Simulates the whole game once so that every checkpoint exists.
+    void BuildCheckpoints()
+    {
+        Seek(game_.GetEndTime());
+    }
+
+    void WriteCheckpoints(std::ostream &out) const
+    {
+        const std::uint64_t logHash = HashBytes(log_.GetData(), log_.GetSize());
+        std::vector<std::uint32_t> words = {kVersion,
+                                            static_cast<std::uint32_t>(log_.GetHeader().commonDivisor),
+                                            log_.GetHeader().seed,
+                                            static_cast<std::uint32_t>(log_.GetSize()),
+                                            static_cast<std::uint32_t>(logHash),
+                                            static_cast<std::uint32_t>(logHash >> 32),
+                                            static_cast<std::uint32_t>(interval_),
+                                            static_cast<std::uint32_t>(checkpoints_.size()),
+                                            0,
+                                            0};
+        for (const Checkpoint &checkpoint : checkpoints_)
+        {
+            words.push_back(static_cast<std::uint32_t>(checkpoint.position.offset));
+            words.push_back(static_cast<std::uint32_t>(checkpoint.position.tick));
+            words.push_back(static_cast<std::uint32_t>(checkpoint.game.size()));
+            words.insert(words.end(), checkpoint.game.begin(), checkpoint.game.end());
+        }
+
+        std::vector<unsigned char> bytes(4 + 4 * words.size());
+        std::memcpy(bytes.data(), kMagic, 4);
+        for (std::size_t i = 0; i < words.size(); ++i)
+        {
+            for (std::size_t j = 0; j < 4; ++j)
+            {
+                bytes[4 + 4 * i + j] = static_cast<unsigned char>(words[i] >> (8 * j));
+            }
+        }
+        const std::uint64_t checkpointsHash = HashBytes(bytes.data() + kHeaderSize, bytes.size() - kHeaderSize);
+        for (std::size_t j = 0; j < 8; ++j)
+        {
+            bytes[kHeaderSize - 8 + j] = static_cast<unsigned char>(checkpointsHash >> (8 * j));
+        }
+        out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    // Replaces the checkpoints with ones written by WriteCheckpoints() for
+    // the same log; false (and no change) if data is not such a file, was
+    // written for another log or holds a checkpoint that does not load.
+    bool LoadCheckpoints(const unsigned char *data, std::size_t size)
+    {
+        std::size_t offset = 4;
+        auto read = [&](std::uint32_t &word) {
+            if (offset + 4 > size)
+                return false;
+            word = 0;
+            for (std::size_t j = 0; j < 4; ++j)
+            {
+                word |= static_cast<std::uint32_t>(data[offset + j]) << (8 * j);
+            }
+            offset += 4;
+            return true;
+        };
+
+        std::uint32_t version, divisor, seed, logSize, logHashLow, logHashHigh, interval, count, checkpointsHashLow,
+            checkpointsHashHigh;
+        if (data == nullptr || size < 4 || std::memcmp(data, kMagic, 4) != 0 || !read(version) ||
+            version != kVersion || !read(divisor) || !read(seed) || !read(logSize) || !read(logHashLow) ||
+            !read(logHashHigh) || !read(interval) || interval == 0 || !read(count) || count == 0 ||
+            !read(checkpointsHashLow) || !read(checkpointsHashHigh) || count > (size - offset) / 12)
+            return false;
+
+        const std::uint64_t logHash = static_cast<std::uint64_t>(logHashHigh) << 32 | logHashLow;
+        const std::uint64_t checkpointsHash = static_cast<std::uint64_t>(checkpointsHashHigh) << 32 | checkpointsHashLow;
+        if (static_cast<int>(divisor) != log_.GetHeader().commonDivisor || seed != log_.GetHeader().seed ||
+            logSize != log_.GetSize() || logHash != HashBytes(log_.GetData(), log_.GetSize()) ||
+            checkpointsHash != HashBytes(data + kHeaderSize, size - kHeaderSize))
+            return false;
+
+        // Every checkpoint must resume the game at its own multiple of interval.
+        Feis::GameManager probe(nullptr, log_.GetHeader().commonDivisor, log_.GetHeader().seed);
+        std::vector<Checkpoint> checkpoints(count);
+        for (std::size_t i = 0; i < checkpoints.size(); ++i)
+        {
+            Checkpoint &checkpoint = checkpoints[i];
+            std::uint32_t logOffset, logTick, length;
+            if (!read(logOffset) || !read(logTick) || !read(length) || length > (size - offset) / 4 ||
+                logOffset < ActionLogHeader::kSize || logOffset > logSize || static_cast<int>(logTick) < 0)
+                return false;
+            checkpoint.position = {logOffset, static_cast<int>(logTick)};
+            checkpoint.game.resize(length);
+            for (int &value : checkpoint.game)
+            {
+                std::uint32_t word;
+                if (!read(word))
+                    return false;
+                value = static_cast<int>(word);
+            }
+
+            if (!probe.LoadCheckpoint(checkpoint.game) ||
+                static_cast<std::size_t>(probe.GetElapsedTime()) != i * interval)
+                return false;
+        }
+
+        interval_ = static_cast<int>(interval);
+        checkpoints_ = std::move(checkpoints);
+        return true;
+    }
+
+private:
+    static constexpr char kMagic[4] = {'P', 'D', 'C', 'K'};
+    static constexpr std::uint32_t kVersion = 2;
+    static constexpr std::size_t kHeaderSize = 44;
+
+    struct Checkpoint
+    {
+        ActionLogReader::Position position;
+        std::vector<int> game;
+    };
+
+    static std::uint64_t HashBytes(const unsigned char *bytes, std::size_t size)
+    {
+        std::uint64_t hash = 0xCBF29CE484222325ull;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    void AddCheckpoint()
+    {
+        checkpoints_.push_back({player_.GetPosition(), {}});
+        game_.SaveCheckpoint(checkpoints_.back().game);
+    }
+
+    ActionLogReader log_;
+    int interval_;
+    ActionLogPlayer player_;
+    Feis::GameManager game_;
+    std::vector<Checkpoint> checkpoints_;
+};
+
+#endif
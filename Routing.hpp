@@ -0,0 +1,293 @@
+#ifndef ROUTING_HPP
+#define ROUTING_HPP
+#include "PDOGS.cpp"
+
+#include <vector>
+
+// Shortest conveyor routes to the collection center. Compute() runs one
+// breadth-first search outward from the collection center over the tiles on
+// which a conveyor can be built, and stores for every tile its distance and
+// the direction of the next tile on a shortest route. Afterwards a route is
+// read off in O(path length) without touching the board again, so players
+// can call it as often as they like. Routes bend around walls and built
+// cells, but the map goes stale as the board changes; call Compute() again
+// after building. IGameInfo::GetDistanceToCollectionCenter() gives the same
+// distances, kept up to date by the board.
+template <typename TConfig>
+class BasicRouteMap
+{
+public:
+    using Engine = Feis::BasicEngine<TConfig>;
+    using CellPosition = Feis::CellPosition;
+    using Direction = Feis::Direction;
+
+    static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+    static constexpr int kUnreachable = -1;
+
+    // One conveyor of a route, facing the next tile.
+    struct Step
+    {
+        CellPosition position;
+        Direction direction;
+    };
+
+    BasicRouteMap() : distances_(kTileCount, kUnreachable), directions_(kTileCount, Direction::kTop)
+    {
+    }
+
+    explicit BasicRouteMap(const typename Engine::IGameInfo &info) : BasicRouteMap()
+    {
+        Compute(info);
+    }
+
+    void Compute(const typename Engine::IGameInfo &info)
+    {
+        using CollectionCenterConfig = typename Engine::GameManager::CollectionCenterConfig;
+
+        std::fill(distances_.begin(), distances_.end(), kUnreachable);
+        std::vector<int> queue;
+        queue.reserve(kTileCount);
+        for (int i = 0; i < static_cast<int>(TConfig::kGoalSize); ++i)
+        {
+            for (int j = 0; j < static_cast<int>(TConfig::kGoalSize); ++j)
+            {
+                const int tile = ToTile({CollectionCenterConfig::kTop + i, CollectionCenterConfig::kLeft + j});
+                distances_[tile] = 0;
+                queue.push_back(tile);
+            }
+        }
+
+        for (std::size_t head = 0; head < queue.size(); ++head)
+        {
+            const CellPosition position = ToPosition(queue[head]);
+            for (int k = 0; k < 4; ++k)
+            {
+                const Direction outward = static_cast<Direction>(k);
+                const CellPosition neighbor = Feis::GetNeighborCellPosition(position, outward);
+                if (!Engine::IsWithinBoard(neighbor))
+                    continue;
+
+                const int tile = ToTile(neighbor);
+                if (distances_[tile] != kUnreachable || !info.GetLayeredCell(neighbor).CanBuild())
+                    continue;
+
+                distances_[tile] = distances_[queue[head]] + 1;
+                directions_[tile] = static_cast<Direction>((k + 2) % 4);
+                queue.push_back(tile);
+            }
+        }
+    }
+
+    // Conveyors on a shortest route from cellPosition into the collection
+    // center: 1 next to it, 0 on it, kUnreachable if there is no route.
+    int GetDistance(CellPosition cellPosition) const
+    {
+        return Engine::IsWithinBoard(cellPosition) ? distances_[ToTile(cellPosition)] : kUnreachable;
+    }
+
+    // The direction a conveyor at cellPosition faces on a shortest route;
+    // false on the collection center and where there is no route.
+    bool GetDirection(CellPosition cellPosition, Direction &direction) const
+    {
+        if (GetDistance(cellPosition) <= 0)
+            return false;
+
+        direction = directions_[ToTile(cellPosition)];
+        return true;
+    }
+
+    // The conveyors of a shortest route from cellPosition, the last one
+    // pointing into the collection center. Empty if there is no route.
+    std::vector<Step> GetRoute(CellPosition cellPosition) const
+    {
+        std::vector<Step> route;
+        const int distance = GetDistance(cellPosition);
+        if (distance <= 0)
+            return route;
+
+        route.reserve(distance);
+        for (CellPosition position = cellPosition; distances_[ToTile(position)] > 0;)
+        {
+            const Direction direction = directions_[ToTile(position)];
+            route.push_back({position, direction});
+            position = Feis::GetNeighborCellPosition(position, direction);
+        }
+        return route;
+    }
+
+private:
+    static int ToTile(CellPosition cellPosition)
+    {
+        return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+    }
+
+    static CellPosition ToPosition(int tile)
+    {
+        return {tile / TConfig::kBoardWidth, tile % TConfig::kBoardWidth};
+    }
+
+    std::vector<int> distances_;
+    std::vector<Direction> directions_;
+};
+
+using RouteMap = BasicRouteMap<Feis::GameManagerConfig>;
+
+// Shortest conveyor routes that may also end at a trunk, a conveyor that
+// already leads into the collection center through conveyors only, for
+// players that route after every move. Reset() finds the trunks by walking
+// the conveyors back from the collection center, then searches outward from
+// them, but only over the tiles that are closer to a trunk than to the
+// collection center. Everywhere else the distance is the board's
+// IGameInfo::GetDistanceToCollectionCenter(), so a Reset() costs about the
+// trunks and the area they serve, not the map. Call it again after building.
+template <typename TConfig>
+class BasicTrunkRouter
+{
+public:
+    using Engine = Feis::BasicEngine<TConfig>;
+    using CellPosition = Feis::CellPosition;
+    using Direction = Feis::Direction;
+    using Step = typename BasicRouteMap<TConfig>::Step;
+
+    static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+    static constexpr int kUnreachable = -1;
+
+    // Dense like the distance field: eight bytes per tile.
+    BasicTrunkRouter() : info_{}, distances_(kTileCount), stamps_(kTileCount), generation_{}
+    {
+    }
+
+    // Routes on info from now on; info must outlive the calls.
+    void Reset(const typename Engine::IGameInfo &info)
+    {
+        using CollectionCenterConfig = typename Engine::GameManager::CollectionCenterConfig;
+
+        info_ = &info;
+        ++generation_;
+        queue_.clear();
+        for (int i = 0; i < static_cast<int>(TConfig::kGoalSize); ++i)
+        {
+            for (int j = 0; j < static_cast<int>(TConfig::kGoalSize); ++j)
+            {
+                queue_.push_back(ToTile({CollectionCenterConfig::kTop + i, CollectionCenterConfig::kLeft + j}));
+            }
+        }
+
+        // The conveyors that output into the collection center or a trunk.
+        const std::size_t trunkStart = queue_.size();
+        for (std::size_t head = 0; head < queue_.size(); ++head)
+        {
+            const CellPosition position = ToPosition(queue_[head]);
+            for (int k = 0; k < 4; ++k)
+            {
+                const CellPosition neighbor = Feis::GetNeighborCellPosition(position, static_cast<Direction>(k));
+                if (!Engine::IsWithinBoard(neighbor) || IsMarked(ToTile(neighbor)))
+                    continue;
+
+                auto conveyor = dynamic_cast<const typename Engine::ConveyorCell *>(
+                    info.GetLayeredCell(neighbor).GetForeground().get());
+                if (conveyor != nullptr && Feis::GetNeighborCellPosition(neighbor, conveyor->GetDirection()) == position)
+                {
+                    Mark(ToTile(neighbor), 0);
+                    queue_.push_back(ToTile(neighbor));
+                }
+            }
+        }
+
+        // Outward from the trunks, through the tiles they are closer to.
+        for (std::size_t head = trunkStart; head < queue_.size(); ++head)
+        {
+            const int tile = queue_[head];
+            for (int k = 0; k < 4; ++k)
+            {
+                const CellPosition neighbor = Feis::GetNeighborCellPosition(ToPosition(tile), static_cast<Direction>(k));
+                if (!Engine::IsWithinBoard(neighbor) || IsMarked(ToTile(neighbor)))
+                    continue;
+
+                const int distance = distances_[tile] + 1;
+                const int fieldDistance = info.GetDistanceToCollectionCenter(neighbor);
+                if (fieldDistance == kUnreachable ? !info.GetLayeredCell(neighbor).CanBuild() : fieldDistance <= distance)
+                    continue;
+
+                Mark(ToTile(neighbor), distance);
+                queue_.push_back(ToTile(neighbor));
+            }
+        }
+    }
+
+    // Conveyors on a shortest route from cellPosition: 0 on the collection
+    // center and on trunks, kUnreachable if there is no route.
+    int GetDistance(CellPosition cellPosition) const
+    {
+        if (!Engine::IsWithinBoard(cellPosition))
+            return kUnreachable;
+
+        const int tile = ToTile(cellPosition);
+        return IsMarked(tile) ? distances_[tile] : info_->GetDistanceToCollectionCenter(cellPosition);
+    }
+
+    bool IsTrunk(CellPosition cellPosition) const
+    {
+        return Engine::IsWithinBoard(cellPosition) && IsMarked(ToTile(cellPosition)) &&
+               distances_[ToTile(cellPosition)] == 0;
+    }
+
+    // Appends the conveyors of a shortest route from cellPosition to route,
+    // the last one facing into the collection center or a trunk; nothing if
+    // GetDistance() is 0, and false if there is no route.
+    bool AppendRoute(CellPosition cellPosition, std::vector<Step> &route) const
+    {
+        int distance = GetDistance(cellPosition);
+        if (distance == kUnreachable)
+            return false;
+
+        for (CellPosition position = cellPosition; distance > 0; --distance)
+        {
+            Direction direction = Direction::kTop;
+            for (int k = 0; k < 4; ++k)
+            {
+                if (GetDistance(Feis::GetNeighborCellPosition(position, static_cast<Direction>(k))) == distance - 1)
+                {
+                    direction = static_cast<Direction>(k);
+                    break;
+                }
+            }
+            route.push_back({position, direction});
+            position = Feis::GetNeighborCellPosition(position, direction);
+        }
+        return true;
+    }
+
+private:
+    static int ToTile(CellPosition cellPosition)
+    {
+        return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+    }
+
+    static CellPosition ToPosition(int tile)
+    {
+        return {tile / TConfig::kBoardWidth, tile % TConfig::kBoardWidth};
+    }
+
+    // Trunks and the tiles closer to one than to the collection center.
+    bool IsMarked(int tile) const
+    {
+        return stamps_[tile] == generation_;
+    }
+
+    void Mark(int tile, int distance)
+    {
+        stamps_[tile] = generation_;
+        distances_[tile] = distance;
+    }
+
+    const typename Engine::IGameInfo *info_;
+    std::vector<int> distances_;
+    std::vector<unsigned int> stamps_;
+    unsigned int generation_;
+    std::vector<int> queue_;
+};
+
+using TrunkRouter = BasicTrunkRouter<Feis::GameManagerConfig>;
+
+#endif
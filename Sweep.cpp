@@ -0,0 +1,156 @@
+#define USE_ENGINE_ONLY
+#include <chrono>
+#include <iomanip>
+
+#include "PDOGS.cpp"
+
+#include "DifferentialCheck.hpp"
+#include "GreedyPlayer.hpp"
+#include "MctsPlayer.hpp"
+#include "SweepRunner.hpp"
+
+// Usage: pdogs_sweep [--seeds FIRST-LAST] [--divisors 1,2,3,4,5] [--threads N] [--no-fast-forward]
+//                    [--player greedy|mcts] [--budget MS] [--verify]
+
+std::vector<int> ParseDivisors(const std::string &text)
+{
+    std::vector<int> divisors;
+    std::size_t begin = 0;
+    while (begin < text.size())
+    {
+        std::size_t end = text.find(',', begin);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        divisors.push_back(std::stoi(text.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+    return divisors;
+}
+
+void PrintStatistics(const std::string &label, const SweepStatistics &statistics)
+{
+    std::cout << std::left << std::setw(10) << label
+              << " games " << std::setw(7) << statistics.games
+              << " mean " << std::setw(9) << std::fixed << std::setprecision(2) << statistics.mean
+              << " stddev " << std::setw(9) << statistics.stddev
+              << " min " << std::setw(6) << statistics.min
+              << " max " << statistics.max << std::endl;
+}
+
+// Runs the differential check of every engine against GameBoard and prints
+// the mismatches. Returns the exit status.
+int Verify(const std::vector<int> &divisors, unsigned int firstSeed, unsigned int lastSeed, std::size_t threadCount)
+{
+    DifferentialCheck check(threadCount);
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<DifferentialCheck::Mismatch> mismatches = check.Run(divisors, firstSeed, lastSeed);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const std::string &engine : DifferentialCheck::GetEngineNames())
+    {
+        const auto count = std::count_if(mismatches.begin(), mismatches.end(),
+                                         [&engine](const DifferentialCheck::Mismatch &mismatch) { return mismatch.engine == engine; });
+        std::cout << std::left << std::setw(10) << engine << " mismatches " << count << std::endl;
+    }
+    for (const DifferentialCheck::Mismatch &mismatch : mismatches)
+    {
+        std::cout << "mismatch: " << mismatch.engine << " " << mismatch.run << " divisor " << mismatch.commonDivisor
+                  << " seed " << mismatch.seed << " tick " << mismatch.tick << std::endl;
+    }
+
+    const std::size_t games = divisors.size() * (lastSeed - firstSeed + 1);
+    std::cout << games << " games on " << DifferentialCheck::GetEngineNames().size() << " engines in "
+              << std::fixed << std::setprecision(3) << elapsed.count() << " s: "
+              << (mismatches.empty() ? "all agree" : "MISMATCH") << std::endl;
+    return mismatches.empty() ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int firstSeed = 0;
+    unsigned int lastSeed = 99;
+    std::vector<int> divisors = {1, 2, 3, 4, 5};
+    std::size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    bool fastForward = true;
+    std::string player = "greedy";
+    MctsPlayer::Options mctsOptions;
+    // The games already run in parallel; each search gets one thread.
+    mctsOptions.threadCount = 1;
+    bool verify = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--seeds" && i + 1 < argc)
+        {
+            const std::string range = argv[++i];
+            const std::size_t dash = range.find('-');
+            firstSeed = std::stoul(range.substr(0, dash));
+            lastSeed = dash == std::string::npos ? firstSeed : std::stoul(range.substr(dash + 1));
+        }
+        else if (arg == "--divisors" && i + 1 < argc)
+        {
+            divisors = ParseDivisors(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            threadCount = std::stoul(argv[++i]);
+        }
+        else if (arg == "--no-fast-forward")
+        {
+            fastForward = false;
+        }
+        else if (arg == "--player" && i + 1 < argc && (argv[i + 1] == std::string("greedy") || argv[i + 1] == std::string("mcts")))
+        {
+            player = argv[++i];
+        }
+        else if (arg == "--budget" && i + 1 < argc)
+        {
+            mctsOptions.timeBudget = std::chrono::milliseconds(std::stoi(argv[++i]));
+        }
+        else if (arg == "--verify")
+        {
+            verify = true;
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--seeds FIRST-LAST] [--divisors 1,2,3] [--threads N] [--no-fast-forward]"
+                      << " [--player greedy|mcts] [--budget MS] [--verify]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (verify)
+        return Verify(divisors, firstSeed, lastSeed, threadCount);
+
+    SweepRunner runner(
+        [&]() -> std::unique_ptr<Feis::IGamePlayer> {
+            if (player == "mcts")
+                return std::make_unique<MctsPlayer>(mctsOptions);
+            return std::make_unique<GreedyPlayer>();
+        },
+        threadCount, fastForward);
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<SweepGame> games = runner.Run(divisors, firstSeed, lastSeed);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::map<int, std::vector<SweepGame>> gamesByDivisor;
+    for (const SweepGame &game : games)
+    {
+        gamesByDivisor[game.commonDivisor].push_back(game);
+    }
+    for (const auto &entry : gamesByDivisor)
+    {
+        PrintStatistics("divisor " + std::to_string(entry.first), SweepRunner::Summarize(entry.second));
+    }
+    PrintStatistics("all", SweepRunner::Summarize(games));
+
+    std::cout << games.size() << " games on " << runner.GetThreadCount() << " threads in "
+              << std::setprecision(3) << elapsed.count() << " s ("
+              << std::setprecision(1) << games.size() / elapsed.count() << " games/sec)" << std::endl;
+}
@@ -0,0 +1,198 @@
+#ifndef SWEEP_RUNNER_HPP
+#define SWEEP_RUNNER_HPP
+#include "PDOGS.cpp"
+
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Fixed set of tasks spread over worker threads. Each worker drains its own
+// deque from the back and, once it runs dry, steals from the front of the
+// other workers' deques.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(std::size_t threadCount)
+        : queues_(std::max<std::size_t>(threadCount, 1))
+    {
+    }
+
+    std::size_t GetThreadCount() const
+    {
+        return queues_.size();
+    }
+
+    // task(worker, index) is called once per index; worker is the id of
+    // the calling thread, in [0, GetThreadCount()).
+    void Run(std::size_t taskCount, const std::function<void(std::size_t, std::size_t)> &task)
+    {
+        for (std::size_t i = 0; i < taskCount; ++i)
+        {
+            queues_[i * queues_.size() / taskCount].tasks.push_back(i);
+        }
+
+        std::vector<std::thread> workers;
+        for (std::size_t worker = 0; worker < queues_.size(); ++worker)
+        {
+            workers.emplace_back([this, worker, &task]() {
+                std::size_t index;
+                while (Pop(worker, index) || Steal(worker, index))
+                {
+                    task(worker, index);
+                }
+            });
+        }
+
+        for (auto &thread : workers)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    bool Pop(std::size_t worker, std::size_t &index)
+    {
+        Queue &queue = queues_[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+
+        index = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool Steal(std::size_t worker, std::size_t &index)
+    {
+        for (std::size_t k = 1; k < queues_.size(); ++k)
+        {
+            Queue &victim = queues_[(worker + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                index = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<Queue> queues_;
+};
+
+struct SweepGame
+{
+    int commonDivisor;
+    unsigned int seed;
+    int scores;
+};
+
+struct SweepStatistics
+{
+    std::size_t games = 0;
+    double mean = 0;
+    double stddev = 0;
+    int min = 0;
+    int max = 0;
+};
+
+// Runs every (divisor, seed) pair as an independent game. The factory is
+// called once per game, so players must not share mutable state. Each worker
+// keeps one arena-backed GameManager and resets it between games.
+class SweepRunner
+{
+public:
+    using PlayerFactory = std::function<std::unique_ptr<Feis::IGamePlayer>()>;
+
+    SweepRunner(PlayerFactory playerFactory, std::size_t threadCount, bool fastForward)
+        : playerFactory_(std::move(playerFactory)), pool_(threadCount), fastForward_(fastForward)
+    {
+    }
+
+    std::vector<SweepGame> Run(const std::vector<int> &commonDivisors, unsigned int firstSeed, unsigned int lastSeed)
+    {
+        std::vector<SweepGame> games;
+        for (int commonDivisor : commonDivisors)
+        {
+            for (unsigned int seed = firstSeed; seed <= lastSeed; ++seed)
+            {
+                games.push_back({commonDivisor, seed, 0});
+            }
+        }
+
+        std::vector<std::unique_ptr<Feis::GameManager>> gameManagers(pool_.GetThreadCount());
+
+        pool_.Run(games.size(), [this, &games, &gameManagers](std::size_t worker, std::size_t index) {
+            SweepGame &game = games[index];
+            std::unique_ptr<Feis::IGamePlayer> player = playerFactory_();
+            std::unique_ptr<Feis::GameManager> &gameManager = gameManagers[worker];
+            if (gameManager == nullptr)
+            {
+                gameManager = std::make_unique<Feis::GameManager>(
+                    player.get(), game.commonDivisor, game.seed, Feis::CellAllocation::kArena);
+                gameManager->SetFastForward(fastForward_);
+            }
+            else
+            {
+                gameManager->Reset(player.get(), game.commonDivisor, game.seed);
+            }
+
+            while (!gameManager->IsGameOver())
+            {
+                gameManager->Update();
+            }
+            game.scores = gameManager->GetScores();
+        });
+
+        return games;
+    }
+
+    std::size_t GetThreadCount() const
+    {
+        return pool_.GetThreadCount();
+    }
+
+    static SweepStatistics Summarize(const std::vector<SweepGame> &games)
+    {
+        SweepStatistics statistics;
+        if (games.empty())
+            return statistics;
+
+        statistics.games = games.size();
+        statistics.min = games.front().scores;
+        statistics.max = games.front().scores;
+
+        double sum = 0;
+        for (const SweepGame &game : games)
+        {
+            sum += game.scores;
+            statistics.min = std::min(statistics.min, game.scores);
+            statistics.max = std::max(statistics.max, game.scores);
+        }
+        statistics.mean = sum / games.size();
+
+        double squares = 0;
+        for (const SweepGame &game : games)
+        {
+            squares += (game.scores - statistics.mean) * (game.scores - statistics.mean);
+        }
+        statistics.stddev = std::sqrt(squares / games.size());
+        return statistics;
+    }
+
+private:
+    PlayerFactory playerFactory_;
+    WorkStealingPool pool_;
+    bool fastForward_;
+};
+#endif
@@ -0,0 +1,697 @@
+#ifndef THROUGHPUT_MODEL_HPP
+#define THROUGHPUT_MODEL_HPP
+#include "PDOGS.cpp"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <vector>
+
+// Predicts what the built network will deliver without simulating the board.
+// Every miner, conveyor and combiner becomes a node that outputs into one
+// other node, into the collection center or nowhere. Compute() follows the
+// products already on the board and kWaves mining intervals of new ones
+// through the nodes, upstream nodes first. Each node only schedules the
+// products that enter it, with the rules of GameBoard::Update():
+// - a miner emits every kMiningInterval ticks and loses the product if its
+//   output has a capacity below 3 at that tick;
+// - a conveyor takes a product only 3 ticks after the previous one, and
+//   passes it on kConveyorBufferSize - 1 ticks after taking it;
+// - a combiner holds one product per slot and emits their sum once both
+//   are filled;
+// - products sent in the same tick are taken in row-major order of the
+//   sending cells.
+// After the last wave the network repeats every kMiningInterval ticks, and
+// the final score is extrapolated from it. The cost is about the number of
+// products followed times their route length, so Compute() can run inside
+// a player's decision loop.
+//
+// Queues are only followed where they form: a conveyor that waits on its
+// output does not delay the products entering it. Miner timers are stale
+// on a board in SchedulingMode::kEventDriven while the miner sleeps.
+template <typename TConfig>
+class BasicThroughputModel
+{
+public:
+    using Engine = Feis::BasicEngine<TConfig>;
+    using CellPosition = Feis::CellPosition;
+    using Direction = Feis::Direction;
+
+    static constexpr int kTileCount = TConfig::kBoardWidth * TConfig::kBoardHeight;
+    // Mining intervals followed before the steady state is assumed.
+    static constexpr int kWaves = 4;
+
+    // What limits the deliveries of a miner.
+    enum class Limit
+    {
+        // Everything it mines reaches the collection center.
+        kMiningInterval,
+        // It does not stand on a NumberCell.
+        kNoNumber,
+        // The bottleneck cell has no room when the miner emits: a conveyor
+        // took another product in the last 3 ticks, or a combiner slot is full.
+        kBlockedOutput,
+        // The output of the bottleneck cell leads nowhere or into a loop.
+        kDeadEnd,
+        // The bottleneck combiner never gets a product for its other slot.
+        kUnpaired,
+    };
+
+    struct MinerReport
+    {
+        CellPosition position;
+        int number;
+        // Products per tick of this miner that reach the collection center
+        // in the steady state.
+        double rate;
+        // Whether what this miner contributes to is scored when it arrives.
+        bool scored;
+        // Ticks from emission into the collection center, or -1.
+        int latency;
+        Limit limit;
+        // The miner itself for kMiningInterval and kNoNumber.
+        CellPosition bottleneck;
+    };
+
+    struct Report
+    {
+        // Products per tick into the collection center in the steady state,
+        // and how many of them are scored.
+        double deliveryRate;
+        double scoredRate;
+        // Scores at the end of the game if nothing is built or removed.
+        int predictedScores;
+        std::vector<MinerReport> miners;
+    };
+
+    const Report &Compute(const typename Engine::IGameInfo &info)
+    {
+        now_ = info.GetElapsedTime();
+        end_ = info.GetEndTime();
+        report_ = Report{};
+        report_.predictedScores = info.GetScores();
+        groups_.clear();
+        CollectNodes(info);
+        ResolveTargets();
+
+        // Products of later waves can still meet the last one on its way.
+        int maxDepth = 0;
+        for (const Node &node : nodes_)
+        {
+            maxDepth = std::max(maxDepth, node.depth);
+        }
+        const int waves = kWaves + (maxDepth + 1) * kConveyorDelay / static_cast<int>(TConfig::kMiningInterval) + 1;
+
+        std::vector<int> order;
+        for (int node = 0; node < static_cast<int>(nodes_.size()); ++node)
+        {
+            Node &current = nodes_[node];
+            if (current.kind == NodeKind::kMiner)
+            {
+                EmitMined(node, waves);
+            }
+            else if (current.deadEnd < 0)
+            {
+                order.push_back(node);
+            }
+        }
+        // Products already on the board go on from where they are.
+        for (int node : order)
+        {
+            EmitInFlight(node);
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            return nodes_[a].depth != nodes_[b].depth ? nodes_[a].depth > nodes_[b].depth : a < b;
+        });
+        for (int node : order)
+        {
+            if (nodes_[node].kind == NodeKind::kConveyor)
+                RunConveyor(node);
+            else
+                RunCombiner(node);
+        }
+
+        for (const Delivery &delivery : deliveries_)
+        {
+            const bool scored = info.IsScoredProduct(delivery.number);
+            if (delivery.wave == kWaves - 1)
+            {
+                report_.deliveryRate += 1.0 / TConfig::kMiningInterval;
+                report_.scoredRate += scored ? 1.0 / TConfig::kMiningInterval : 0.0;
+            }
+            Settle(delivery.group, Limit::kMiningInterval, -1, delivery.time, scored);
+            if (!scored || delivery.time > end_ || delivery.wave >= kWaves)
+                continue;
+
+            // The last wave repeats until the end of the game.
+            ++report_.predictedScores;
+            if (delivery.wave == kWaves - 1)
+            {
+                report_.predictedScores += (end_ - delivery.time) / static_cast<int>(TConfig::kMiningInterval);
+            }
+        }
+        return report_;
+    }
+
+    const Report &GetReport() const
+    {
+        return report_;
+    }
+
+private:
+    static constexpr int kSink = -1;
+    static constexpr int kNowhere = -2;
+    static constexpr int kNever = INT_MIN / 2;
+    static constexpr int kConveyorDelay = static_cast<int>(TConfig::kConveyorBufferSize) - 1;
+
+    enum class NodeKind : std::uint8_t
+    {
+        kMiner,
+        kConveyor,
+        kCombiner,
+    };
+
+    // The miners a product came from: a leaf per mined product, and a node
+    // per combined one.
+    struct Group
+    {
+        int miner;
+        int wave;
+        int time;
+        int left;
+        int right;
+    };
+
+    struct Product
+    {
+        int number;
+        int group;
+        int wave;
+    };
+
+    // A product that a cell tries to send into a node in pass one of a tick.
+    struct Request
+    {
+        int time;
+        // Row-major index of the sending cell; products sent in the same
+        // tick are taken in this order.
+        int order;
+        int sender;
+        int port;
+        Product product;
+    };
+
+    struct Slot
+    {
+        bool full;
+        Product product;
+        int time;
+        int order;
+    };
+
+    struct Node
+    {
+        NodeKind kind;
+        // The tile updated for the cell, which orders it within a tick.
+        int tile;
+        CellPosition position;
+        Direction direction;
+        int target;
+        int targetPort;
+        // The node whose output leads nowhere or into a loop, or -1.
+        int deadEnd;
+        int depth;
+        int lastSent;
+        // Miners: the number, the tick of the next emission and the report.
+        int number;
+        int nextEmission;
+        int report;
+        // Conveyors: the tick at which the last product was taken.
+        int lastTaken;
+        std::array<int, TConfig::kConveyorBufferSize> products;
+        // Combiners.
+        std::array<Slot, 2> slots;
+    };
+
+    struct Delivery
+    {
+        int time;
+        int number;
+        int wave;
+        int group;
+    };
+
+    class NodeVisitor : public Engine::CellVisitor
+    {
+    public:
+        NodeVisitor(Node *node, CellPosition position) : node_(node), position_(position) {}
+
+        void Visit(const typename Engine::MiningMachineCell *cell) const override
+        {
+            node_->kind = NodeKind::kMiner;
+            node_->direction = cell->GetDirection();
+            node_->number = cell->GetMinedNumber();
+            node_->nextEmission = static_cast<int>(cell->GetIdleTicks(position_)) + 1;
+            valid_ = true;
+        }
+
+        void Visit(const typename Engine::ConveyorCell *cell) const override
+        {
+            node_->kind = NodeKind::kConveyor;
+            node_->direction = cell->GetDirection();
+            for (std::size_t i = 0; i < node_->products.size(); ++i)
+            {
+                node_->products[i] = cell->GetProduct(i);
+            }
+            valid_ = true;
+        }
+
+        void Visit(const typename Engine::CombinerCell *cell) const override
+        {
+            if (!cell->IsMainCell(position_))
+                return;
+
+            node_->kind = NodeKind::kCombiner;
+            node_->direction = cell->GetDirection();
+            node_->slots[0].product.number = cell->GetFirstSlotProduct();
+            node_->slots[1].product.number = cell->GetSecondSlotProduct();
+            valid_ = true;
+        }
+
+        bool IsValid() const { return valid_; }
+
+    private:
+        Node *node_;
+        CellPosition position_;
+        mutable bool valid_ = false;
+    };
+
+    static int ToTile(CellPosition cellPosition)
+    {
+        return cellPosition.row * TConfig::kBoardWidth + cellPosition.col;
+    }
+
+    // One node per updatable tile. Combiners also map their other tile to
+    // their node, as its second slot.
+    void CollectNodes(const typename Engine::IGameInfo &info)
+    {
+        nodes_.clear();
+        deliveries_.clear();
+        nodeOfTile_.assign(kTileCount, -1);
+        for (int row = 0; row < TConfig::kBoardHeight; ++row)
+        {
+            for (int col = 0; col < TConfig::kBoardWidth; ++col)
+            {
+                const CellPosition position{row, col};
+                const typename Engine::ForegroundCell *foreground = info.GetLayeredCell(position).GetForeground().get();
+                if (foreground == nullptr || !foreground->IsUpdatable(position))
+                    continue;
+
+                Node node{};
+                node.tile = ToTile(position);
+                node.position = foreground->GetTopLeftCellPosition();
+                node.lastSent = kNever;
+                node.lastTaken = kNever;
+                NodeVisitor visitor(&node, position);
+                foreground->Accept(&visitor);
+                if (!visitor.IsValid())
+                    continue;
+
+                if (node.kind == NodeKind::kMiner)
+                {
+                    node.nextEmission += now_;
+                    node.report = static_cast<int>(report_.miners.size());
+                    report_.miners.push_back({position, node.number, 0.0, false, -1,
+                                              node.number == 0 ? Limit::kNoNumber : Limit::kDeadEnd, position});
+                }
+                nodeOfTile_[node.tile] = static_cast<int>(nodes_.size());
+                nodes_.push_back(node);
+            }
+        }
+
+        for (int node = 0; node < static_cast<int>(nodes_.size()); ++node)
+        {
+            if (nodes_[node].kind != NodeKind::kCombiner)
+                continue;
+
+            const CellPosition topLeft = nodes_[node].position;
+            const bool wide = nodes_[node].direction == Direction::kTop || nodes_[node].direction == Direction::kBottom;
+            const CellPosition other = topLeft + (wide ? CellPosition{0, 1} : CellPosition{1, 0});
+            const int otherTile = ToTile(nodes_[node].tile == ToTile(topLeft) ? other : topLeft);
+            nodeOfTile_[otherTile] = node;
+        }
+        // Products sent into each node, kept allocated between calls.
+        if (requests_.size() < nodes_.size())
+        {
+            requests_.resize(nodes_.size());
+        }
+        for (std::size_t node = 0; node < nodes_.size(); ++node)
+        {
+            requests_[node].clear();
+        }
+    }
+
+    static bool IsCollectionCenter(CellPosition cellPosition)
+    {
+        using CollectionCenterConfig = typename Engine::GameManager::CollectionCenterConfig;
+        return cellPosition.row >= CollectionCenterConfig::kTop &&
+               cellPosition.row < CollectionCenterConfig::kTop + static_cast<int>(TConfig::kGoalSize) &&
+               cellPosition.col >= CollectionCenterConfig::kLeft &&
+               cellPosition.col < CollectionCenterConfig::kLeft + static_cast<int>(TConfig::kGoalSize);
+    }
+
+    // Where every node outputs, and whether that leads to the collection
+    // center.
+    void ResolveTargets()
+    {
+        for (int node = 0; node < static_cast<int>(nodes_.size()); ++node)
+        {
+            Node &current = nodes_[node];
+            const CellPosition position{current.tile / TConfig::kBoardWidth, current.tile % TConfig::kBoardWidth};
+            const CellPosition next = Feis::GetNeighborCellPosition(position, current.direction);
+            current.target = kNowhere;
+            current.depth = -1;
+            current.deadEnd = -1;
+            if (!Engine::IsWithinBoard(next))
+                continue;
+
+            const int tile = ToTile(next);
+            if (IsCollectionCenter(next))
+            {
+                current.target = kSink;
+                continue;
+            }
+            const int target = nodeOfTile_[tile];
+            if (target < 0 || nodes_[target].kind == NodeKind::kMiner)
+                continue;
+
+            current.target = target;
+            current.targetPort = nodes_[target].kind == NodeKind::kCombiner && nodes_[target].tile != tile ? 1 : 0;
+        }
+
+        // Walks each route until a resolved node, then fills in the route
+        // backwards. A node still on the stack closes a loop.
+        std::vector<int> route;
+        std::vector<std::uint8_t> state(nodes_.size(), 0);
+        for (int start = 0; start < static_cast<int>(nodes_.size()); ++start)
+        {
+            route.clear();
+            int node = start;
+            while (state[node] == 0)
+            {
+                state[node] = 1;
+                route.push_back(node);
+                if (nodes_[node].target < 0)
+                    break;
+                node = nodes_[node].target;
+            }
+
+            if (route.empty())
+                continue;
+
+            int depth = 0;
+            int deadEnd = -1;
+            const Node &last = nodes_[route.back()];
+            if (last.target == kNowhere)
+            {
+                deadEnd = route.back();
+            }
+            else if (last.target >= 0)
+            {
+                const Node &resolved = nodes_[last.target];
+                deadEnd = state[last.target] == 1 ? last.target : resolved.deadEnd;
+                depth = resolved.depth + 1;
+            }
+            for (auto it = route.rbegin(); it != route.rend(); ++it)
+            {
+                nodes_[*it].depth = depth++;
+                nodes_[*it].deadEnd = deadEnd;
+                state[*it] = 2;
+            }
+        }
+    }
+
+    int AddGroup(const Group &group)
+    {
+        groups_.push_back(group);
+        return static_cast<int>(groups_.size()) - 1;
+    }
+
+    void EmitMined(int node, int waves)
+    {
+        const Node &miner = nodes_[node];
+        if (miner.number == 0)
+            return;
+
+        for (int wave = 0; wave < waves; ++wave)
+        {
+            const int time = miner.nextEmission + wave * static_cast<int>(TConfig::kMiningInterval);
+            const int group = AddGroup({miner.report, wave, time, -1, -1});
+            Send(node, {time, miner.tile, node, 0, {miner.number, group, wave}});
+        }
+    }
+
+    void EmitInFlight(int node)
+    {
+        Node &current = nodes_[node];
+        if (current.kind == NodeKind::kConveyor)
+        {
+            for (int slot = 0; slot < static_cast<int>(current.products.size()); ++slot)
+            {
+                const int number = current.products[slot];
+                if (number == 0)
+                    continue;
+
+                // A product at slot k leaves in k + 1 ticks. One near the
+                // back was taken recently and keeps the conveyor busy.
+                const int group = AddGroup({-1, -1, now_, -1, -1});
+                Send(node, {now_ + slot + 1, current.tile, node, 0, {number, group, -1}});
+                current.lastTaken = std::max(current.lastTaken, now_ - (kConveyorDelay - 1 - slot));
+            }
+            return;
+        }
+
+        for (Slot &slot : current.slots)
+        {
+            slot.full = slot.product.number != 0;
+            if (!slot.full)
+                continue;
+
+            // Already held at the end of the last tick.
+            slot.product.group = AddGroup({-1, -1, now_, -1, -1});
+            slot.product.wave = -1;
+            slot.time = now_;
+            slot.order = INT_MAX;
+        }
+    }
+
+    // Pass one of node sends a product towards its target.
+    void Send(int node, const Request &request)
+    {
+        const Node &sender = nodes_[node];
+        if (sender.target == kSink)
+        {
+            deliveries_.push_back({request.time, request.product.number, request.product.wave, request.product.group});
+            return;
+        }
+        if (sender.deadEnd >= 0 || sender.target < 0)
+        {
+            Settle(request.product.group, Limit::kDeadEnd, sender.deadEnd >= 0 ? sender.deadEnd : node, request.time);
+            return;
+        }
+
+        Request forwarded = request;
+        forwarded.port = sender.targetPort;
+        requests_[sender.target].push_back(forwarded);
+    }
+
+    template <typename TAccept>
+    void RunRequests(std::vector<Request> &requests, TAccept accept)
+    {
+        const auto later = [](const Request &a, const Request &b) {
+            return a.time != b.time ? a.time > b.time : a.order > b.order;
+        };
+        std::make_heap(requests.begin(), requests.end(), later);
+        while (!requests.empty())
+        {
+            std::pop_heap(requests.begin(), requests.end(), later);
+            Request request = requests.back();
+            requests.pop_back();
+
+            // A conveyor hands out at most one product every 3 ticks.
+            Node &sender = nodes_[request.sender];
+            if (sender.kind == NodeKind::kConveyor && request.time < sender.lastSent + 3)
+            {
+                request.time = sender.lastSent + 3;
+            }
+            else
+            {
+                const int retry = accept(request);
+                if (retry == kNever)
+                {
+                    sender.lastSent = request.time;
+                    continue;
+                }
+                // Miners lose what they cannot send.
+                if (sender.kind == NodeKind::kMiner || retry == INT_MAX)
+                    continue;
+                request.time = retry;
+            }
+            requests.push_back(request);
+            std::push_heap(requests.begin(), requests.end(), later);
+        }
+    }
+
+    void RunConveyor(int node)
+    {
+        std::vector<Request> &requests = requests_[node];
+        RunRequests(requests, [this, node](const Request &request) {
+            Node &conveyor = nodes_[node];
+            if (request.time < conveyor.lastTaken + 3)
+            {
+                if (nodes_[request.sender].kind == NodeKind::kMiner)
+                {
+                    Settle(request.product.group, Limit::kBlockedOutput, node, request.time);
+                }
+                return conveyor.lastTaken + 3;
+            }
+
+            conveyor.lastTaken = request.time;
+            Send(node, {request.time + kConveyorDelay, conveyor.tile, node, 0, request.product});
+            return kNever;
+        });
+    }
+
+    void RunCombiner(int node)
+    {
+        std::vector<Request> &requests = requests_[node];
+        std::array<std::vector<Request>, 2> waiting;
+        // A slot emptied by an emission takes products again once the
+        // combiner's pass one has run in that tick.
+        std::array<int, 2> freedAt = {kNever, kNever};
+        const auto firstFreeTick = [this, node, &freedAt](int port, int order) {
+            return freedAt[port] + (order < nodes_[node].tile ? 1 : 0);
+        };
+        const auto emitIfFull = [this, node, &requests, &waiting, &freedAt]() {
+            Node &combiner = nodes_[node];
+            Slot &first = combiner.slots[0];
+            Slot &second = combiner.slots[1];
+            if (!first.full || !second.full)
+                return;
+
+            // Pass one of the combiner sees a product sent earlier in the
+            // same tick, and a later one in the next tick.
+            const auto ready = [&combiner](const Slot &slot) {
+                return slot.time + (slot.order < combiner.tile ? 0 : 1);
+            };
+            const int time = std::max(ready(first), ready(second));
+            const int wave = std::max(first.product.wave, second.product.wave);
+            const int group = AddGroup({-1, wave, time, first.product.group, second.product.group});
+            first.full = false;
+            second.full = false;
+            freedAt = {time, time};
+            Send(node, {time, combiner.tile, node, 0, {first.product.number + second.product.number, group, wave}});
+            for (std::vector<Request> &port : waiting)
+            {
+                for (Request &request : port)
+                {
+                    requests.push_back(request);
+                    std::push_heap(requests.begin(), requests.end(), [](const Request &a, const Request &b) {
+                        return a.time != b.time ? a.time > b.time : a.order > b.order;
+                    });
+                }
+                port.clear();
+            }
+        };
+        emitIfFull();
+
+        RunRequests(requests, [&](const Request &request) {
+            Node &combiner = nodes_[node];
+            Slot &slot = combiner.slots[request.port];
+            const bool miner = nodes_[request.sender].kind == NodeKind::kMiner;
+            if (slot.full || request.time < firstFreeTick(request.port, request.order))
+            {
+                if (miner)
+                {
+                    Settle(request.product.group, Limit::kBlockedOutput, node, request.time);
+                    return INT_MAX;
+                }
+                if (slot.full)
+                {
+                    // Waits until the other slot is filled.
+                    waiting[request.port].push_back(request);
+                    return INT_MAX;
+                }
+                return firstFreeTick(request.port, request.order);
+            }
+
+            slot = {true, request.product, request.time, request.order};
+            emitIfFull();
+            return kNever;
+        });
+
+        Node &combiner = nodes_[node];
+        for (int port = 0; port < 2; ++port)
+        {
+            if (combiner.slots[port].full)
+            {
+                Settle(combiner.slots[port].product.group, Limit::kUnpaired, node, combiner.slots[port].time);
+            }
+            for (const Request &request : waiting[port])
+            {
+                Settle(request.product.group, Limit::kUnpaired, node, request.time);
+            }
+        }
+    }
+
+    // Records the fate of a product in the reports of the miners whose last
+    // wave it carries. bottleneck is -1 for a delivered product.
+    void Settle(int group, Limit limit, int bottleneck, int time, bool scored = false)
+    {
+        settleStack_.assign(1, group);
+        while (!settleStack_.empty())
+        {
+            const Group current = groups_[settleStack_.back()];
+            settleStack_.pop_back();
+            if (current.left >= 0)
+            {
+                if (current.wave == kWaves - 1)
+                {
+                    settleStack_.push_back(current.left);
+                    settleStack_.push_back(current.right);
+                }
+                continue;
+            }
+            if (current.miner < 0 || current.wave != kWaves - 1)
+                continue;
+
+            MinerReport &report = report_.miners[current.miner];
+            report.limit = limit;
+            if (bottleneck < 0)
+            {
+                report.rate = 1.0 / TConfig::kMiningInterval;
+                report.scored = scored;
+                report.latency = time - current.time;
+                report.bottleneck = report.position;
+            }
+            else
+            {
+                report.bottleneck = nodes_[bottleneck].position;
+            }
+        }
+    }
+
+    int now_ = 0;
+    int end_ = 0;
+    Report report_{};
+    std::vector<Node> nodes_;
+    std::vector<int> nodeOfTile_;
+    std::vector<std::vector<Request>> requests_;
+    std::vector<Group> groups_;
+    std::vector<Delivery> deliveries_;
+    std::vector<int> settleStack_;
+};
+
+using ThroughputModel = BasicThroughputModel<Feis::GameManagerConfig>;
+
+#endif